@@ -3,6 +3,7 @@ layout (location = 0) in vec3 inPos;
 layout (location = 1) in float inRadius;
 layout (location = 2) in vec4 inColor;
 layout (location = 3) in vec3 inVel;
+layout (location = 4) in vec3 inPrevPos;
 
 out VS_OUT {
     vec4 color;
@@ -12,6 +13,8 @@ out VS_OUT {
 
 uniform mat4 uView;
 uniform mat4 uProj;
+uniform float uAlpha; // blend factor between previous and current simulation step
+uniform float uPointScale = 1.0; // scene resolution relative to the viewport
 // simple size attenuation by distance to avoid giant points near camera
 float attenuate(float base, float dist){
     float s = base / (1.0 + 0.001 * dist);
@@ -19,7 +22,7 @@ float attenuate(float base, float dist){
 }
 
 void main() {
-    vec4 worldPos = vec4(inPos, 1.0);
+    vec4 worldPos = vec4(mix(inPrevPos, inPos, uAlpha), 1.0);
     vec4 viewPos = uView * worldPos;
     gl_Position = uProj * viewPos;
     float dist = length(viewPos.xyz);
@@ -31,6 +34,6 @@ void main() {
     vec3 vView = mat3(uView) * inVel;
     vec2 d = normalize(vec2(vView.x, vView.y) + 1e-6);
     vs_out.dir2 = d;
-    gl_PointSize = base * (1.0 + 0.25*vs_out.stretch);
+    gl_PointSize = base * (1.0 + 0.25*vs_out.stretch) * uPointScale;
     vs_out.color = inColor;
 }
@@ -0,0 +1,120 @@
+#include "AllocationTracker.h"
+
+#if defined(COSMOS_TRACK_ALLOCATIONS)
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+constexpr int kPhases = (int)FramePhase::Count;
+constexpr int kNoPhase = (int)FramePhase::Count;
+thread_local int tPhase = kNoPhase;
+// last simulation phase entered, inherited by OpenMP workers
+std::atomic<int> gWorkerPhase{(int)FramePhase::Other};
+std::atomic<uint64_t> gCount[kPhases];
+std::atomic<uint64_t> gBytes[kPhases];
+AllocationCounters gLast[kPhases];
+
+void record(size_t bytes) {
+    int p = tPhase;
+    if (p == kNoPhase) {
+        p = (int)FramePhase::Other;
+#ifdef _OPENMP
+        if (omp_in_parallel()) p = gWorkerPhase.load(std::memory_order_relaxed);
+#endif
+    }
+    gCount[p].fetch_add(1, std::memory_order_relaxed);
+    gBytes[p].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void* trackedAlloc(size_t bytes) {
+    record(bytes);
+    if (bytes == 0) bytes = 1;
+    return std::malloc(bytes);
+}
+
+void* trackedAlignedAlloc(size_t bytes, size_t align) {
+    record(bytes);
+    if (bytes == 0) bytes = 1;
+#if defined(_MSC_VER)
+    return _aligned_malloc(bytes, align);
+#else
+    return std::aligned_alloc(align, (bytes + align - 1) / align * align);
+#endif
+}
+
+void trackedAlignedFree(void* p) {
+#if defined(_MSC_VER)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+} // namespace
+
+void AllocationTracker::beginFrame() {
+    for (int i = 0; i < kPhases; ++i) {
+        gLast[i].count = gCount[i].exchange(0, std::memory_order_relaxed);
+        gLast[i].bytes = gBytes[i].exchange(0, std::memory_order_relaxed);
+    }
+}
+
+FramePhase AllocationTracker::setPhase(FramePhase p) {
+    int prev = tPhase;
+    tPhase = (int)p;
+    bool shared = p != FramePhase::Render && p != FramePhase::Other;
+    if (shared || p == FramePhase::Count) {
+        gWorkerPhase.store(shared ? (int)p : (int)FramePhase::Other, std::memory_order_relaxed);
+    }
+    return (FramePhase)prev;
+}
+
+AllocationCounters AllocationTracker::lastFrame(FramePhase p) { return gLast[(int)p]; }
+
+void AllocationTracker::recordExternal(size_t bytes) { record(bytes); }
+
+AllocationCounters AllocationTracker::lastFrameTotal() {
+    AllocationCounters t;
+    for (int i = 0; i < kPhases; ++i) { t.count += gLast[i].count; t.bytes += gLast[i].bytes; }
+    return t;
+}
+
+// Global replacements
+void* operator new(size_t n) {
+    if (void* p = trackedAlloc(n)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t n) {
+    if (void* p = trackedAlloc(n)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return trackedAlloc(n); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return trackedAlloc(n); }
+void* operator new(size_t n, std::align_val_t a) {
+    if (void* p = trackedAlignedAlloc(n, (size_t)a)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t n, std::align_val_t a) {
+    if (void* p = trackedAlignedAlloc(n, (size_t)a)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return trackedAlignedAlloc(n, (size_t)a); }
+void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return trackedAlignedAlloc(n, (size_t)a); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { trackedAlignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { trackedAlignedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { trackedAlignedFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { trackedAlignedFree(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { trackedAlignedFree(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { trackedAlignedFree(p); }
+
+#endif // COSMOS_TRACK_ALLOCATIONS
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "FramePhase.h"
+
+struct AllocationCounters {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+// Counts heap allocations per frame and per phase by replacing the global
+// operator new/delete. Only compiled in with -DCOSMOS_TRACK_ALLOCATIONS=ON;
+// otherwise every call below is a no-op and enabled() returns false.
+// The phase is tracked per thread. Simulation phases are also shared with the
+// OpenMP workers of the thread that set them, so allocations inside a
+// parallel loop are attributed to the enclosing phase; threads with no phase
+// count as FramePhase::Other. Memory that bypasses operator new (the mmap
+// blocks of PageAllocator) is reported through recordExternal.
+class AllocationTracker {
+public:
+#if defined(COSMOS_TRACK_ALLOCATIONS)
+    static constexpr bool enabled() { return true; }
+    static void beginFrame(); // closes the previous frame's counters
+    static FramePhase setPhase(FramePhase p); // returns the previous phase (Count = none)
+    static AllocationCounters lastFrame(FramePhase p);
+    static AllocationCounters lastFrameTotal();
+    static void recordExternal(size_t bytes); // counted like an operator new of bytes
+#else
+    static constexpr bool enabled() { return false; }
+    static void beginFrame() {}
+    static FramePhase setPhase(FramePhase) { return FramePhase::Count; }
+    static AllocationCounters lastFrame(FramePhase) { return {}; }
+    static AllocationCounters lastFrameTotal() { return {}; }
+    static void recordExternal(size_t) {}
+#endif
+
+    class PhaseScope {
+    public:
+        explicit PhaseScope(FramePhase p): prev(setPhase(p)) {}
+        ~PhaseScope() { setPhase(prev); }
+        PhaseScope(const PhaseScope&) = delete;
+        PhaseScope& operator=(const PhaseScope&) = delete;
+    private:
+        FramePhase prev;
+    };
+};
@@ -0,0 +1,36 @@
+#include "BackgroundPotential.h"
+#include <algorithm>
+#include <cmath>
+
+glm::vec3 backgroundAccel(const BackgroundPotential& bg, float G, float softening, const glm::vec3& pos) {
+    return backgroundPull(bg, G, softening, bg.center - pos);
+}
+
+template <typename T, int D>
+glm::vec<D, T> backgroundPull(const BackgroundPotential& bg, T G, T softening, const glm::vec<D, T>& r) {
+    T r2 = glm::dot(r, r);
+    const T mass = bg.mass, scale = bg.scale;
+    switch (bg.type) {
+        case BackgroundPotentialType::PointMass: {
+            T d2 = r2 + softening * softening;
+            return r * (G * mass / (d2 * std::sqrt(d2)));
+        }
+        case BackgroundPotentialType::Plummer: {
+            T d2 = r2 + scale * scale;
+            return r * (G * mass / (d2 * std::sqrt(d2)));
+        }
+        case BackgroundPotentialType::NFW: {
+            // enclosed mass M_s [ln(1 + x) - x / (1 + x)], x = r / r_s
+            T d = std::sqrt(r2 + softening * softening);
+            T x = d / std::max(scale, T(1e-6));
+            T enclosed = mass * (std::log1p(x) - x / (T(1) + x));
+            return r * (G * enclosed / (d * d * d));
+        }
+        default: return glm::vec<D, T>(T(0));
+    }
+}
+
+template glm::vec<3, float> backgroundPull(const BackgroundPotential&, float, float, const glm::vec<3, float>&);
+template glm::vec<3, double> backgroundPull(const BackgroundPotential&, double, double, const glm::vec<3, double>&);
+template glm::vec<2, float> backgroundPull(const BackgroundPotential&, float, float, const glm::vec<2, float>&);
+template glm::vec<2, double> backgroundPull(const BackgroundPotential&, double, double, const glm::vec<2, double>&);
@@ -0,0 +1,25 @@
+#pragma once
+#include <glm/glm.hpp>
+
+enum class BackgroundPotentialType {
+    None,
+    PointMass, // softened by the simulation softening
+    Plummer,   // M r / (r^2 + a^2)^(3/2)
+    NFW        // mass is M_s = 4 pi rho_0 r_s^3, scale is r_s
+};
+
+// Static analytic potential added to the particle forces, e.g. a dark halo
+// that would otherwise need millions of particles
+struct BackgroundPotential {
+    BackgroundPotentialType type = BackgroundPotentialType::None;
+    float mass = 100000.0f;
+    float scale = 200.0f;
+    glm::vec3 center{0.0f}; // simulation frame
+};
+
+// Acceleration at pos (simulation frame)
+glm::vec3 backgroundAccel(const BackgroundPotential& bg, float G, float softening, const glm::vec3& pos);
+// Acceleration at offset toCenter = center - pos, in any scalar type and dimension
+// (float and double, 2D and 3D are instantiated)
+template <typename T, int D>
+glm::vec<D, T> backgroundPull(const BackgroundPotential& bg, T G, T softening, const glm::vec<D, T>& toCenter);
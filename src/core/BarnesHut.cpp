@@ -1,146 +1,766 @@
 #include "BarnesHut.h"
+#include "SimdKernels.h"
 #include <algorithm>
 #include <cmath>
+#include <type_traits>
+#include <glm/gtc/constants.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-static AABB computeBounds(const std::vector<Particle>& particles) {
-    if (particles.empty()) return {};
-    glm::vec3 minp = particles[0].position;
-    glm::vec3 maxp = particles[0].position;
-    for (const auto& p : particles) {
-        minp = glm::min(minp, p.position);
-        maxp = glm::max(maxp, p.position);
-    }
-    AABB b;
-    b.center = (minp + maxp) * 0.5f;
-    b.halfSize = (maxp - b.center) + glm::vec3(1e-3f);
+// Largest component; the opening test uses the widest extent of a node
+template <typename T, int D>
+static T maxComponent(const glm::vec<D, T>& v) {
+    T m = v[0];
+    for (int a = 1; a < D; ++a) m = std::max(m, v[a]);
+    return m;
+}
+
+template <typename T, int D, typename Position>
+static BasicAABB<T, D> computeBounds(const Position& position, const int* indices, int n) {
+    if (n == 0) return {};
+    glm::vec<D, T> minp = position(indices[0]);
+    glm::vec<D, T> maxp = minp;
+    for (int k = 0; k < n; ++k) {
+        const glm::vec<D, T>& p = position(indices[k]);
+        minp = glm::min(minp, p);
+        maxp = glm::max(maxp, p);
+    }
+    BasicAABB<T, D> b;
+    b.center = (minp + maxp) * T(0.5);
+    b.halfSize = (maxp - b.center) + glm::vec<D, T>(T(1e-3));
     return b;
 }
 
-void BarnesHut::build(const std::vector<Particle>& particles) {
-    std::vector<int> idx(particles.size());
-    for (int i = 0; i < (int)particles.size(); ++i) idx[i] = i;
-    AABB bounds = computeBounds(particles);
-    root = buildRecursive(particles, bounds, idx, 0);
-    accumulateMass(root.get(), particles);
+// Node moments: accumulate weighted sums, then finishMoments turns them into centres
+template <typename T, int D>
+static void addMoments(BasicOctreeNode<T, D>* n, T mass, const glm::vec<D, T>& com, T q, const glm::vec<D, T>& cq) {
+    n->mass += mass;
+    n->com += mass * com;
+    if (q > T(0)) { n->qPos += q; n->cPos += q * cq; }
+    else if (q < T(0)) { n->qNeg += q; n->cNeg += q * cq; }
 }
 
-std::unique_ptr<OctreeNode> BarnesHut::buildRecursive(const std::vector<Particle>& particles, const AABB& bounds, const std::vector<int>& indices, int depth) {
-    auto node = std::make_unique<OctreeNode>();
-    node->box = bounds;
+template <typename T, int D>
+static void addChildMoments(BasicOctreeNode<T, D>* n, const BasicOctreeNode<T, D>* c) {
+    n->mass += c->mass; n->com += c->mass * c->com;
+    n->qPos += c->qPos; n->cPos += c->qPos * c->cPos;
+    n->qNeg += c->qNeg; n->cNeg += c->qNeg * c->cNeg;
+}
 
-    if ((int)indices.size() <= params.maxLeafSize || depth > 32) {
-        node->indices = indices;
-        return node;
+template <typename T, int D>
+static void clearMoments(BasicOctreeNode<T, D>* n) {
+    n->mass = n->qPos = n->qNeg = T(0);
+    n->com = n->cPos = n->cNeg = glm::vec<D, T>(T(0));
+}
+
+template <typename T, int D>
+static void finishMoments(BasicOctreeNode<T, D>* n) {
+    if (n->mass > T(0)) n->com /= n->mass;
+    else n->com = n->box.center;
+    n->cPos = (n->qPos > T(0)) ? n->cPos / n->qPos : n->com;
+    n->cNeg = (n->qNeg < T(0)) ? n->cNeg / n->qNeg : n->com;
+}
+
+// Slot k of the source arrays of the float 3D walks
+template <typename Sources, typename V, typename S>
+static void storeSource(Sources& s, int k, const V& position, S mass, S charge) {
+    s.x[k] = position.x;
+    s.y[k] = position.y;
+    s.z[k] = position.z;
+    s.m[k] = mass;
+    s.q[k] = charge;
+}
+
+static int threadIndex() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static bool inParallel() {
+#ifdef _OPENMP
+    return omp_in_parallel() != 0;
+#else
+    return false;
+#endif
+}
+
+static int maxThreads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+template <typename T, int D>
+void BasicBarnesHut<T, D>::build(const Particles& particles) {
+    buildAt(particles, [&](int i) -> const Vec& { return particles[i].position; }, true);
+}
+
+template <typename T, int D>
+void BasicBarnesHut<T, D>::build(const Particles& particles, const Vec* positions) {
+    // the moments change with the refit, so the lists are walked there
+    buildAt(particles, [positions](int i) -> const Vec& { return positions[i]; }, false);
+}
+
+template <typename T, int D>
+template <typename Position>
+void BasicBarnesHut<T, D>::buildAt(const Particles& particles, const Position& position, bool walkLists) {
+    // Recycle last frame's nodes; arenas keep their blocks
+    if ((int)arenas.size() < maxThreads()) {
+        arenas.resize(maxThreads());
+        for (auto& a : arenas) a.setPool(arenaPool.get());
     }
+    for (auto& a : arenas) a.reset();
+    root = nullptr;
 
-    glm::vec3 c = bounds.center;
-    glm::vec3 hs = bounds.halfSize * 0.5f;
+    // tree particles first, then the rest, each in particle order
+    const int n = (int)particles.size();
+    order.resize(n);
+    treeSize = 0;
+    for (int i = 0; i < n; ++i) if (inTree(particles[i])) order[treeSize++] = i;
+    for (int i = 0, t = treeSize; i < n; ++i) if (!inTree(particles[i])) order[t++] = i;
+    if constexpr (kSourceArrays) {
+        for (auto* a : { &sources.x, &sources.y, &sources.z, &sources.m, &sources.q }) a->resize(treeSize);
+    }
+    if (treeSize == 0) { listGroups = 0; return; }
+    Box bounds = computeBounds<T, D>(position, order.data(), treeSize);
+    if (inParallel()) {
+        // called by one thread of a team: the subtree tasks go to that team,
+        // run by whichever threads reach a scheduling point with nothing else to do
+        root = buildRecursive(particles, position, bounds, 0, treeSize, 0);
+    } else {
+        #pragma omp parallel
+        {
+            #pragma omp single
+            root = buildRecursive(particles, position, bounds, 0, treeSize, 0);
+        }
+    }
+    if (!listed) return;
 
-    // Prepare child AABBs
-    AABB childBoxes[8];
-    for (int i = 0; i < 8; ++i) {
-        glm::vec3 offset = glm::vec3((i & 1) ? hs.x : -hs.x,
-                                     (i & 2) ? hs.y : -hs.y,
-                                     (i & 4) ? hs.z : -hs.z) * 0.5f;
-        childBoxes[i].center = c + offset * 2.0f;
-        childBoxes[i].halfSize = hs;
+    // groups: the highest nodes of at most listGroupSize particles
+    listOf.assign(n, -1);
+    int groups = 0;
+    const Node* stack[kStackSize];
+    int top = 0;
+    stack[top++] = root;
+    while (top > 0) {
+        const Node* node = stack[--top];
+        if (!node->isLeaf() && node->count > params.listGroupSize) {
+            for (const Node* c : node->children) if (c) stack[top++] = c;
+            continue;
+        }
+        if (groups == (int)lists.size()) {
+            // new lists take the usual capacity now rather than at their first walk
+            const size_t old = lists.size();
+            lists.resize(old + old / 4 + 1);
+            for (size_t l = old; l < lists.size(); ++l) reserveList(lists[l]);
+        }
+        lists[groups].group = node;
+        for (int k = node->first; k < node->first + node->count; ++k) listOf[order[k]] = groups;
+        ++groups;
     }
+    listGroups = groups;
+    listsPending = !walkLists;
+    if (walkLists) updateLists(true);
+}
 
-    std::vector<int> childIndices[8];
-    for (int i = 0; i < 8; ++i) childIndices[i].reserve(indices.size() / 8 + 1);
+template <typename T, int D>
+template <typename Position>
+typename BasicBarnesHut<T, D>::Node* BasicBarnesHut<T, D>::buildRecursive(const Particles& particles, const Position& position,
+                                                                          const Box& bounds, int first, int count, int depth) {
+    Node* node = arenas[threadIndex()].template create<Node>();
+    node->box = bounds;
+    node->first = first;
+    node->count = count;
 
-    for (int idx : indices) {
-        const glm::vec3& p = particles[idx].position;
-        for (int i = 0; i < 8; ++i) {
-            if (childBoxes[i].contains(p)) {
-                childIndices[i].push_back(idx);
-                break;
-            }
+    if (count <= params.maxLeafSize || depth > kMaxDepth) {
+        clearMoments(node);
+        for (int k = first; k < first + count; ++k) {
+            const auto& p = particles[order[k]];
+            const Vec& x = position(order[k]);
+            addMoments(node, p.mass, x, p.charge, x);
+            if constexpr (kSourceArrays) storeSource(sources, k, x, p.mass, p.charge);
         }
+        finishMoments(node);
+        return node;
     }
 
-    bool allEmpty = true;
-    // Collect work items to enable parallel build of independent children
-    struct Task { int idx; };
-    std::vector<Task> tasks; tasks.reserve(8);
-    for (int i = 0; i < 8; ++i) if (!childIndices[i].empty()) { tasks.push_back({i}); allEmpty = false; }
+    Vec c = bounds.center;
+    Vec hs = bounds.halfSize * T(0.5);
 
-    #pragma omp parallel for schedule(static) if(tasks.size() > 2)
-    for (int ti = 0; ti < (int)tasks.size(); ++ti) {
-        int i = tasks[ti].idx;
-        auto child = buildRecursive(particles, childBoxes[i], childIndices[i], depth + 1);
-        // publish
-        node->children[i] = std::move(child);
+    // Partition the index range in place into children (bit a = axis a), the
+    // highest axis first; a point exactly on a split plane goes to the lower child
+    constexpr int kChildren = Node::kChildren;
+    int* split[kChildren + 1];
+    split[0] = order.data() + first;
+    split[kChildren] = split[0] + count;
+    auto partitionAxis = [&](int* b, int* e, int axis) {
+        return std::partition(b, e, [&](int idx) { return !(position(idx)[axis] > c[axis]); });
+    };
+    for (int axis = D - 1; axis >= 0; --axis) {
+        const int span = 2 << axis;
+        for (int q = 0; q < kChildren; q += span) split[q + span / 2] = partitionAxis(split[q], split[q + span], axis);
     }
 
-    if (allEmpty) {
-        node->indices = indices;
+    node->leaf = false;
+    for (int i = 0; i < kChildren; ++i) {
+        int childFirst = (int)(split[i] - order.data());
+        int childCount = (int)(split[i + 1] - split[i]);
+        if (childCount == 0) continue;
+        Box childBox;
+        for (int a = 0; a < D; ++a) childBox.center[a] = c[a] + (((i >> a) & 1) ? hs[a] : -hs[a]);
+        childBox.halfSize = hs;
+        // Large subtrees become tasks; each child writes only its own slot
+        #pragma omp task default(shared) firstprivate(i, childBox, childFirst, childCount) if(childCount > params.buildTaskCutoff)
+        node->children[i] = buildRecursive(particles, position, childBox, childFirst, childCount, depth + 1);
     }
+    #pragma omp taskwait
+
+    clearMoments(node);
+    for (const Node* ch : node->children) if (ch) addChildMoments(node, ch);
+    finishMoments(node);
     return node;
 }
 
-void BarnesHut::accumulateMass(OctreeNode* node, const std::vector<Particle>& particles) {
-    if (!node) return;
+template <typename T, int D>
+void BasicBarnesHut<T, D>::refit(const Particles& particles) {
+    if (!root || order.size() != particles.size()) return;
+    #pragma omp parallel
+    {
+        #pragma omp single
+        refitRecursive(particles, root);
+    }
+    if (listed) updateLists(listsPending);
+    listsPending = false;
+}
+
+template <typename T, int D>
+void BasicBarnesHut<T, D>::refreshSources(const Particles& particles) {
+    if constexpr (kSourceArrays) {
+        if (order.size() != particles.size()) return;
+        #pragma omp parallel for schedule(static)
+        for (int k = 0; k < treeSize; ++k) {
+            const auto& p = particles[order[k]];
+            storeSource(sources, k, p.position, p.mass, p.charge);
+        }
+    } else {
+        (void)particles;
+    }
+}
+
+template <typename T, int D>
+void BasicBarnesHut<T, D>::refitRecursive(const Particles& particles, Node* node) {
+    Vec minp(T(0)), maxp(T(0));
+    clearMoments(node);
     if (node->isLeaf()) {
-        node->mass = 0.0f;
-        node->com = glm::vec3(0.0f);
-        for (int idx : node->indices) {
-            node->mass += particles[idx].mass;
-            node->com += particles[idx].mass * particles[idx].position;
+        if (node->count == 0) return;
+        minp = maxp = particles[order[node->first]].position;
+        for (int k = node->first; k < node->first + node->count; ++k) {
+            const auto& p = particles[order[k]];
+            minp = glm::min(minp, p.position);
+            maxp = glm::max(maxp, p.position);
+            if constexpr (kSourceArrays) storeSource(sources, k, p.position, p.mass, p.charge);
+            if (!inTree(p)) continue; // spawned into a tree slot since the build
+            addMoments(node, p.mass, p.position, p.charge, p.position);
+        }
+    } else {
+        for (Node* ch : node->children) {
+            if (!ch) continue;
+            #pragma omp task default(shared) firstprivate(ch) if(ch->count > params.buildTaskCutoff)
+            refitRecursive(particles, ch);
+        }
+        #pragma omp taskwait
+        bool any = false;
+        for (const Node* ch : node->children) {
+            if (!ch) continue;
+            Vec lo = ch->box.center - ch->box.halfSize, hi = ch->box.center + ch->box.halfSize;
+            minp = any ? glm::min(minp, lo) : lo;
+            maxp = any ? glm::max(maxp, hi) : hi;
+            any = true;
+            addChildMoments(node, ch);
+        }
+    }
+    // Tight boxes: the opening test uses the largest extent, so drifted particles stay covered
+    node->box.center = (minp + maxp) * T(0.5);
+    node->box.halfSize = (maxp - node->box.center) + Vec(T(1e-3));
+    finishMoments(node);
+}
+
+// Entry distance of the ray into box grown by pad, or a negative value on a miss
+template <typename T, int D>
+static T slabEnter(const BasicAABB<T, D>& box, T pad, const glm::vec<D, T>& origin, const glm::vec<D, T>& invDir) {
+    glm::vec<D, T> lo = (box.center - box.halfSize - pad - origin) * invDir;
+    glm::vec<D, T> hi = (box.center + box.halfSize + pad - origin) * invDir;
+    glm::vec<D, T> tmin = glm::min(lo, hi), tmax = glm::max(lo, hi);
+    T enter = std::max(maxComponent(tmin), T(0));
+    T exit = -maxComponent(-tmax);
+    return (enter <= exit) ? enter : T(-1);
+}
+
+template <typename T, int D>
+int BasicBarnesHut<T, D>::raycast(const Particles& particles, const Vec& origin, const Vec& dir, T pickRadius,
+                                  T maxParticleRadius, int nodeBudget, T* tHit) const {
+    // 1/0 = inf keeps the slab test valid for axis-parallel rays
+    const Vec invDir = T(1) / dir;
+    const T pad = pickRadius + maxParticleRadius;
+    int best = -1;
+    T bestT = T(INFINITY);
+
+    struct Item { const Node* node; T enter; };
+    Item stack[kStackSize];
+    int top = 0;
+    T rootEnter = root ? slabEnter(root->box, pad, origin, invDir) : T(-1);
+    if (rootEnter >= T(0)) stack[top++] = { root, rootEnter };
+    int visited = 0;
+    while (top > 0 && visited < nodeBudget) {
+        Item it = stack[--top];
+        if (it.enter > bestT) continue;
+        ++visited;
+        const Node* node = it.node;
+        if (node->isLeaf()) {
+            for (int k = node->first; k < node->first + node->count; ++k) {
+                T t = particleRayHit(particles[order[k]], origin, dir, pickRadius);
+                if (t >= T(0) && t < bestT) { bestT = t; best = order[k]; }
+            }
+            continue;
+        }
+        // push children far to near so the nearest is popped first
+        Item kids[Node::kChildren];
+        int n = 0;
+        for (const Node* c : node->children) {
+            if (!c) continue;
+            T e = slabEnter(c->box, pad, origin, invDir);
+            if (e < T(0) || e > bestT) continue;
+            int j = n++;
+            while (j > 0 && kids[j - 1].enter < e) { kids[j] = kids[j - 1]; --j; }
+            kids[j] = { c, e };
+        }
+        for (int j = 0; j < n; ++j) stack[top++] = kids[j];
+    }
+    // particles outside the tree are tested directly (picks are rare)
+    for (int k = treeSize; k < (int)order.size(); ++k) {
+        T t = particleRayHit(particles[order[k]], origin, dir, pickRadius);
+        if (t >= T(0) && t < bestT) { bestT = t; best = order[k]; }
+    }
+    if (tHit) *tHit = bestT;
+    return best;
+}
+
+template <typename T, int D>
+size_t BasicBarnesHut<T, D>::memoryBytes() const {
+    size_t total = order.capacity() * sizeof(int);
+    for (const auto& a : arenas) total += a.bytesReserved();
+    total += arenaPool->bytesReserved();
+    total += lists.capacity() * sizeof(InteractionList) + listOf.capacity() * sizeof(int);
+    for (const auto& l : lists) {
+        total += l.cellNodes.capacity() * sizeof(const Node*) + (l.leafFirst.capacity() + l.leafCount.capacity()) * sizeof(int);
+        total += (l.cx.capacity() + l.cy.capacity() + l.cz.capacity() + l.cm.capacity()) * sizeof(float);
+    }
+    return total;
+}
+
+template <typename T, int D>
+void BasicBarnesHut<T, D>::collectStructure(TreeStats& st) const {
+    st.nodes = 0; st.leaves = 0; st.maxDepth = 0; st.meanLeafDepth = 0.0;
+    for (size_t& b : st.leafOccupancy) b = 0;
+    st.memoryReserved = memoryBytes();
+    if (!root) { st.memoryUsed = 0; return; }
+
+    struct Item { const Node* node; int depth; };
+    Item stack[kStackSize];
+    int top = 0;
+    stack[top++] = { root, 0 };
+    size_t depthSum = 0;
+    while (top > 0) {
+        Item it = stack[--top];
+        ++st.nodes;
+        st.maxDepth = std::max(st.maxDepth, it.depth);
+        if (it.node->isLeaf()) {
+            ++st.leaves;
+            depthSum += it.depth;
+            ++st.leafOccupancy[std::min(it.node->count, TreeStats::kOccupancyBins - 1)];
+        } else {
+            for (const Node* c : it.node->children) if (c) stack[top++] = { c, it.depth + 1 };
         }
-        if (node->mass > 0.0f) node->com /= node->mass;
-        else node->com = node->box.center;
-        return;
     }
-    node->mass = 0.0f;
-    node->com = glm::vec3(0.0f);
-    for (const auto& c : node->children) {
-        if (!c) continue;
-        accumulateMass(c.get(), particles);
-        node->mass += c->mass;
-        node->com += c->mass * c->com;
+    st.meanLeafDepth = st.leaves ? (double)depthSum / (double)st.leaves : 0.0;
+    st.memoryUsed = st.nodes * sizeof(Node) + order.size() * sizeof(int);
+}
+
+template <typename T, int D>
+void BasicBarnesHut<T, D>::setParams(const BarnesHutParams& p) {
+    params = p;
+    // erfc split factor F(r) = erfc(r / 2r_s) + r / (r_s sqrt(pi)) exp(-r^2 / 4r_s^2), tabulated in r / r_s
+    splitTable.clear();
+    if (params.splitScale > 0.0f) {
+        splitTable.resize(kSplitTableSize + 2);
+        for (int k = 0; k <= kSplitTableSize + 1; ++k) {
+            double u = (double)k * kSplitCutoff / kSplitTableSize;
+            splitTable[k] = (T)(std::erfc(0.5 * u) + u / std::sqrt(glm::pi<double>()) * std::exp(-0.25 * u * u));
+        }
     }
-    if (node->mass > 0.0f) node->com /= node->mass;
-    else node->com = node->box.center;
+
+    walkPlain = selectWalk<NoTraversalStats>(params);
+    walkCounted = selectWalk<TraversalCounters>(params);
+    // lists are made by the next build; until then walkListed falls back to the plain walk
+    listed = kSourceArrays && params.listGroupSize > 0 && params.splitScale <= 0.0f && params.kernel == SofteningKernel::Plummer
+          && params.coulombK == 0.0f && params.opening != OpeningCriterion::RelativeAcceleration;
+    listGroups = 0;
+    listOf.clear();
+}
+
+// One walk per (split, kernel, criterion); the switches run once per setParams
+template <typename T, int D>
+template <typename Stats>
+typename BasicBarnesHut<T, D>::template WalkFn<Stats> BasicBarnesHut<T, D>::selectWalk(const BarnesHutParams& p) {
+    auto byOpening = [&](auto split, auto kernel) -> WalkFn<Stats> {
+        constexpr bool Split = decltype(split)::value;
+        using Kernel = decltype(kernel);
+        switch (p.opening) {
+            case OpeningCriterion::SalmonWarren: return &BasicBarnesHut::walk<Split, Kernel, SalmonWarrenOpening, Stats>;
+            case OpeningCriterion::RelativeAcceleration: return &BasicBarnesHut::walk<Split, Kernel, RelativeAccelerationOpening, Stats>;
+            default: return &BasicBarnesHut::walk<Split, Kernel, GeometricOpening, Stats>;
+        }
+    };
+    if constexpr (kSourceArrays) {
+        if (p.splitScale <= 0.0f && p.kernel == SofteningKernel::Plummer && p.coulombK == 0.0f) {
+            if (p.listGroupSize > 0) {
+                switch (p.opening) {
+                    case OpeningCriterion::SalmonWarren: return &BasicBarnesHut::walkListed<SalmonWarrenOpening, Stats>;
+                    case OpeningCriterion::RelativeAcceleration: break; // per particle: |a_old| differs within a group
+                    default: return &BasicBarnesHut::walkListed<GeometricOpening, Stats>;
+                }
+            }
+            switch (p.opening) {
+                case OpeningCriterion::SalmonWarren: return &BasicBarnesHut::walkVectorized<SalmonWarrenOpening, Stats>;
+                case OpeningCriterion::RelativeAcceleration: return &BasicBarnesHut::walkVectorized<RelativeAccelerationOpening, Stats>;
+                default: return &BasicBarnesHut::walkVectorized<GeometricOpening, Stats>;
+            }
+        }
+    }
+    auto byKernel = [&](auto split) -> WalkFn<Stats> {
+        switch (p.kernel) {
+            case SofteningKernel::CubicSpline: return byOpening(split, CubicSplineSoftening{});
+            case SofteningKernel::Compact: return byOpening(split, CompactSoftening{});
+            default: return byOpening(split, PlummerSoftening{});
+        }
+    };
+    if (p.splitScale > 0.0f) return byKernel(std::true_type{});
+    return byKernel(std::false_type{});
+}
+
+template <typename T, int D>
+template <typename Stats>
+typename BasicBarnesHut<T, D>::Vec BasicBarnesHut<T, D>::computeForce(int i, const Particles& particles, Stats& stats, T accelOld) const {
+    if constexpr (std::is_same_v<Stats, NoTraversalStats>) return (this->*walkPlain)(i, particles, stats, accelOld);
+    else return (this->*walkCounted)(i, particles, stats, accelOld);
 }
 
-glm::vec3 BarnesHut::computeForce(int i, const std::vector<Particle>& particles) const {
-    const Particle& pi = particles[i];
-    glm::vec3 force(0.0f);
+// Split: short-range part of a TreePM solve. Separations are minimum images
+// in the periodic box, pair forces are scaled by the erfc split factor and
+// nodes farther than kSplitCutoff r_s are skipped outright. Charges are ignored.
+template <typename T, int D>
+template <bool Split, typename Kernel, typename Opening, typename Stats>
+typename BasicBarnesHut<T, D>::Vec BasicBarnesHut<T, D>::walk(int i, const Particles& particles, Stats& stats, T accelOld) const {
+    const auto& pi = particles[i];
+    Vec force(T(0));
+    // electric field over K, summed in the same walk when both charges matter
+    const bool coulomb = !Split && params.coulombK != 0.0f && pi.charge != T(0) && pi.mass > T(0);
+    Vec field(T(0));
+    const T G = params.G;
+    const T eps2 = T(params.softening) * T(params.softening);
+    auto monopoleField = [&](T q, const Vec& at) {
+        Vec r = pi.position - at;
+        field += q * Kernel::invCube(glm::dot(r, r), eps2) * r;
+    };
+    const OpeningContext<T> opening{ T(params.theta), (G > T(0)) ? T(params.accelTolerance) * accelOld / G : T(0) };
+    const T box = params.periodicBox, halfBox = T(0.5) * box;
+    const T cutoff = T(kSplitCutoff) * T(params.splitScale);
+    // a particle farther than the cutoff from every face sees no periodic image
+    const bool wrap = Split && box > T(0) && glm::any(glm::greaterThan(glm::abs(pi.position), Vec(halfBox - cutoff)));
+    const T toTable = (params.splitScale > 0.0f) ? T(kSplitTableSize) / cutoff : T(0);
+    auto image = [&](Vec r) {
+        // positions are wrapped into the box, so one shift per axis is enough
+        if constexpr (Split) {
+            if (wrap) {
+                for (int a = 0; a < D; ++a) r[a] += (r[a] > halfBox) ? -box : (r[a] < -halfBox ? box : T(0));
+            }
+        }
+        return r;
+    };
+    auto splitFactor = [&](T dist) {
+        T u = dist * toTable;
+        if (u >= (T)kSplitTableSize) return T(0);
+        int k = (int)u;
+        T f = u - (T)k;
+        return splitTable[k] + f * (splitTable[k + 1] - splitTable[k]);
+    };
 
-    std::vector<const OctreeNode*> stack;
-    stack.reserve(64);
-    stack.push_back(root.get());
+    const Node* stack[kStackSize];
+    int top = 0;
+    if (root) stack[top++] = root;
 
-    while (!stack.empty()) {
-        const OctreeNode* node = stack.back();
-        stack.pop_back();
-        if (!node || node->mass <= 0.0f) continue;
+    while (top > 0) {
+        const Node* node = stack[--top];
+        if (node->mass <= T(0) && (!coulomb || (node->qPos == T(0) && node->qNeg == T(0)))) continue;
+        if constexpr (Split) {
+            Vec gap = glm::max(glm::abs(image(node->box.center - pi.position)) - node->box.halfSize, Vec(T(0)));
+            if (glm::dot(gap, gap) > cutoff * cutoff) continue;
+        }
 
         if (node->isLeaf()) {
-            for (int idx : node->indices) {
-                if (idx == i) continue;
-                const Particle& pj = particles[idx];
-                glm::vec3 r = pj.position - pi.position;
-                float dist2 = glm::dot(r, r) + params.softening * params.softening;
-                float invDist = 1.0f / sqrtf(dist2);
-                float invDist3 = invDist * invDist * invDist;
-                force += params.G * pj.mass * invDist3 * r;
+            for (int k = node->first; k < node->first + node->count; ++k) {
+                if (order[k] == i) continue;
+                stats.onParticle();
+                Vec pos;
+                T mass, charge;
+                if constexpr (kSourceArrays) {
+                    pos = Vec(sources.x[k], sources.y[k], sources.z[k]);
+                    mass = sources.m[k];
+                    charge = sources.q[k];
+                } else {
+                    const auto& pj = particles[order[k]];
+                    pos = pj.position; mass = pj.mass; charge = pj.charge;
+                }
+                Vec r = image(pos - pi.position);
+                T r2 = glm::dot(r, r);
+                T invDist3 = Kernel::invCube(r2, eps2);
+                if constexpr (Split) invDist3 *= splitFactor(std::sqrt(r2));
+                force += G * mass * invDist3 * r;
+                if (coulomb) field -= charge * invDist3 * r;
             }
         } else {
-            glm::vec3 r = node->com - pi.position;
-            float dist = glm::length(r) + 1e-6f;
-            float s = 2.0f * std::max(std::max(node->box.halfSize.x, node->box.halfSize.y), node->box.halfSize.z); // be conservative if box not cubic
-            if ((s / dist) < params.theta) {
-                float dist2 = dist * dist + params.softening * params.softening;
-                float invDist = 1.0f / sqrtf(dist2);
-                float invDist3 = invDist * invDist * invDist;
-                force += params.G * node->mass * invDist3 * r;
+            Vec r = image(node->com - pi.position);
+            T dist = glm::length(r) + T(1e-6);
+            T s = T(2) * maxComponent(node->box.halfSize); // be conservative if box not cubic
+            if (Opening::accept(*node, r, dist, s, opening)) {
+                stats.onCell();
+                T invDist3 = Kernel::invCube(dist * dist, eps2);
+                if constexpr (Split) invDist3 *= splitFactor(dist);
+                force += G * node->mass * invDist3 * r;
+                if (coulomb) {
+                    if (node->qPos != T(0)) monopoleField(node->qPos, node->cPos);
+                    if (node->qNeg != T(0)) monopoleField(node->qNeg, node->cNeg);
+                }
             } else {
-                for (const auto& c : node->children) if (c) stack.push_back(c.get());
+                stats.onOpen();
+                for (const Node* c : node->children) if (c) stack[top++] = c;
             }
         }
     }
 
+    if (coulomb) force += (T(params.coulombK) * pi.charge / pi.mass) * field;
     return force;
 }
+
+// The walk above for float 3D Plummer gravity, with the arithmetic handed to
+// SimdKernels::gravity: leaf ranges (merged when adjacent in tree order) and
+// accepted nodes are listed, and each full batch is summed in one call.
+template <typename T, int D>
+template <typename Opening, typename Stats>
+typename BasicBarnesHut<T, D>::Vec BasicBarnesHut<T, D>::walkVectorized(int i, const Particles& particles, Stats& stats, T accelOld) const {
+    const auto& pi = particles[i];
+    const T G = params.G;
+    const T eps2 = T(params.softening) * T(params.softening);
+    const OpeningContext<T> opening{ T(params.theta), (G > T(0)) ? T(params.accelTolerance) * accelOld / G : T(0) };
+    const SimdKernels& simd = simdKernels();
+    const GravitySources src{ sources.x.data(), sources.y.data(), sources.z.data(), sources.m.data() };
+    const float p[3] = { pi.position.x, pi.position.y, pi.position.z };
+
+    constexpr int kBatch = 64;
+    int leafFirst[kBatch], leafCount[kBatch];
+    float cx[kBatch], cy[kBatch], cz[kBatch], cm[kBatch];
+    int leaves = 0, cells = 0;
+    Vec sum(T(0));
+    auto flush = [&]() {
+        float a[3];
+        simd.gravity(src, GravityList{ leafFirst, leafCount, leaves, cx, cy, cz, cm, cells }, p, eps2, a);
+        sum += Vec(a[0], a[1], a[2]);
+        leaves = cells = 0;
+    };
+
+    const Node* stack[kStackSize];
+    int top = 0;
+    if (root) stack[top++] = root;
+
+    while (top > 0) {
+        const Node* node = stack[--top];
+        if (node->mass <= T(0)) continue;
+
+        if (node->isLeaf()) {
+            // the particle itself sits at r = 0, which the kernel drops
+            if constexpr (!std::is_same_v<Stats, NoTraversalStats>) {
+                for (int k = node->first; k < node->first + node->count; ++k) if (order[k] != i) stats.onParticle();
+            }
+            const int end = node->first + node->count;
+            if (leaves > 0 && leafFirst[leaves - 1] == end) {
+                leafFirst[leaves - 1] = node->first;
+                leafCount[leaves - 1] += node->count;
+            } else if (leaves > 0 && leafFirst[leaves - 1] + leafCount[leaves - 1] == node->first) {
+                leafCount[leaves - 1] += node->count;
+            } else {
+                if (leaves == kBatch) flush();
+                leafFirst[leaves] = node->first;
+                leafCount[leaves++] = node->count;
+            }
+        } else {
+            Vec r = node->com - pi.position;
+            T dist = glm::length(r) + T(1e-6);
+            T s = T(2) * maxComponent(node->box.halfSize);
+            if (Opening::accept(*node, r, dist, s, opening)) {
+                stats.onCell();
+                if (cells == kBatch) flush();
+                cx[cells] = node->com.x;
+                cy[cells] = node->com.y;
+                cz[cells] = node->com.z;
+                cm[cells++] = node->mass;
+            } else {
+                stats.onOpen();
+                for (const Node* c : node->children) if (c) stack[top++] = c;
+            }
+        }
+    }
+    if (leaves > 0 || cells > 0) flush();
+    return G * sum;
+}
+
+template <typename T, int D>
+void BasicBarnesHut<T, D>::updateLists(bool rebuilt) {
+    if constexpr (kSourceArrays) {
+        if (params.opening == OpeningCriterion::SalmonWarren) updateListsWith<SalmonWarrenOpening>(rebuilt);
+        else updateListsWith<GeometricOpening>(rebuilt);
+    } else {
+        (void)rebuilt;
+    }
+}
+
+// After a build every list is walked. After a refit the group and node boxes
+// and centres of mass have moved a little: an accepted node that still
+// passes against the new group box keeps its place (only its monopole is
+// refreshed), opened nodes stay opened, and any failure means a new walk.
+template <typename T, int D>
+template <typename Opening>
+void BasicBarnesHut<T, D>::updateListsWith(bool rebuilt) {
+    const OpeningContext<T> opening{ T(params.theta), T(0) };
+    int walks = 0;
+    size_t longestCells = 0, longestLeaves = 0;
+    #pragma omp parallel for schedule(dynamic, 16) reduction(+:walks) reduction(max:longestCells, longestLeaves)
+    for (int g = 0; g < listGroups; ++g) {
+        InteractionList& list = lists[g];
+        bool valid = !rebuilt;
+        const Box& box = list.group->box;
+        for (size_t c = 0; valid && c < list.cellNodes.size(); ++c) {
+            const Node& node = *list.cellNodes[c];
+            Vec gap = glm::max(glm::abs(node.com - box.center) - box.halfSize, Vec(T(0)));
+            valid = Opening::accept(node, gap, glm::length(gap) + T(1e-6), T(2) * maxComponent(node.box.halfSize), opening);
+        }
+        if (!valid) {
+            walkList<Opening>(list);
+            ++walks;
+            longestCells = std::max(longestCells, list.cellNodes.size());
+            longestLeaves = std::max(longestLeaves, list.leafFirst.size());
+            continue;
+        }
+        for (size_t c = 0; c < list.cellNodes.size(); ++c) {
+            const Node& node = *list.cellNodes[c];
+            list.cx[c] = node.com.x; list.cy[c] = node.com.y; list.cz[c] = node.com.z; list.cm[c] = node.mass;
+        }
+    }
+    rewalked = walks;
+    if (longestCells <= listCellCap && longestLeaves <= listLeafCap) return;
+    listCellCap = std::max(listCellCap, longestCells + longestCells / 4);
+    listLeafCap = std::max(listLeafCap, longestLeaves + longestLeaves / 4);
+    // idle lists too, so a later build that needs more groups does not allocate
+    for (size_t l = listGroups; l < lists.size(); ++l) reserveList(lists[l]);
+}
+
+template <typename T, int D>
+void BasicBarnesHut<T, D>::reserveList(InteractionList& list) const {
+    list.cellNodes.reserve(listCellCap);
+    for (auto* v : { &list.cx, &list.cy, &list.cz, &list.cm }) v->reserve(listCellCap);
+    list.leafFirst.reserve(listLeafCap); list.leafCount.reserve(listLeafCap);
+}
+
+// The walk of walkVectorized with the group box in place of a particle: the
+// distance to a node is the gap between its centre of mass and the box, so
+// whatever is accepted is accepted for every member. Massless nodes are kept
+// (a respawned slot may give them mass before the next build).
+template <typename T, int D>
+template <typename Opening>
+void BasicBarnesHut<T, D>::walkList(InteractionList& list) const {
+    list.cellNodes.clear();
+    list.cx.clear(); list.cy.clear(); list.cz.clear(); list.cm.clear();
+    list.leafFirst.clear(); list.leafCount.clear();
+    reserveList(list);
+    const Box& box = list.group->box;
+    const OpeningContext<T> opening{ T(params.theta), T(0) };
+    const Node* stack[kStackSize];
+    int top = 0;
+    stack[top++] = root;
+    while (top > 0) {
+        const Node* node = stack[--top];
+        if (node->isLeaf()) {
+            const int end = node->first + node->count;
+            if (!list.leafFirst.empty() && list.leafFirst.back() == end) {
+                list.leafFirst.back() = node->first;
+                list.leafCount.back() += node->count;
+            } else if (!list.leafFirst.empty() && list.leafFirst.back() + list.leafCount.back() == node->first) {
+                list.leafCount.back() += node->count;
+            } else {
+                list.leafFirst.push_back(node->first);
+                list.leafCount.push_back(node->count);
+            }
+            continue;
+        }
+        // an ancestor of the group holds the group itself, however far its centre of mass
+        const bool ancestor = node->first <= list.group->first && list.group->first < node->first + node->count;
+        Vec gap = glm::max(glm::abs(node->com - box.center) - box.halfSize, Vec(T(0)));
+        if (!ancestor && Opening::accept(*node, gap, glm::length(gap) + T(1e-6), T(2) * maxComponent(node->box.halfSize), opening)) {
+            list.cellNodes.push_back(node);
+            list.cx.push_back(node->com.x); list.cy.push_back(node->com.y); list.cz.push_back(node->com.z);
+            list.cm.push_back(node->mass);
+        } else {
+            for (const Node* c : node->children) if (c) stack[top++] = c;
+        }
+    }
+}
+
+// Tree particles sum their group's list in one SimdKernels::gravity call; the
+// rest (and everything before the first build with lists) walk as usual
+template <typename T, int D>
+template <typename Opening, typename Stats>
+typename BasicBarnesHut<T, D>::Vec BasicBarnesHut<T, D>::walkListed(int i, const Particles& particles, Stats& stats, T accelOld) const {
+    const int l = (i < (int)listOf.size()) ? listOf[i] : -1;
+    if (l < 0) return walkVectorized<Opening, Stats>(i, particles, stats, accelOld);
+    const InteractionList& list = lists[l];
+    if constexpr (!std::is_same_v<Stats, NoTraversalStats>) {
+        int others = -1; // its own leaf is in the list
+        for (int c : list.leafCount) others += c;
+        for (int k = 0; k < others; ++k) stats.onParticle();
+        for (size_t c = 0; c < list.cellNodes.size(); ++c) stats.onCell();
+    }
+    const auto& pi = particles[i];
+    const float p[3] = { pi.position.x, pi.position.y, pi.position.z };
+    const GravitySources src{ sources.x.data(), sources.y.data(), sources.z.data(), sources.m.data() };
+    const GravityList gl{ list.leafFirst.data(), list.leafCount.data(), (int)list.leafFirst.size(),
+                          list.cx.data(), list.cy.data(), list.cz.data(), list.cm.data(), (int)list.cm.size() };
+    float a[3];
+    simdKernels().gravity(src, gl, p, T(params.softening) * T(params.softening), a);
+    return T(params.G) * Vec(a[0], a[1], a[2]);
+}
+
+#define INSTANTIATE_BARNES_HUT(T, D)                                                                                  \
+    template class BasicBarnesHut<T, D>;                                                                              \
+    template BasicBarnesHut<T, D>::Vec BasicBarnesHut<T, D>::computeForce<NoTraversalStats>(int, const BasicBarnesHut<T, D>::Particles&, NoTraversalStats&, T) const; \
+    template BasicBarnesHut<T, D>::Vec BasicBarnesHut<T, D>::computeForce<TraversalCounters>(int, const BasicBarnesHut<T, D>::Particles&, TraversalCounters&, T) const;
+
+INSTANTIATE_BARNES_HUT(float, 3)
+INSTANTIATE_BARNES_HUT(double, 3)
+INSTANTIATE_BARNES_HUT(float, 2)
+INSTANTIATE_BARNES_HUT(double, 2)
+#undef INSTANTIATE_BARNES_HUT
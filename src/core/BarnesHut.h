@@ -1,49 +1,293 @@
 #pragma once
-#include <vector>
+#include <cmath>
+#include <cstdint>
 #include <memory>
+#include <type_traits>
+#include <vector>
 #include <glm/glm.hpp>
 #include "Particle.h"
+#include "FrameArena.h"
+#include "ForcePolicies.h"
 
 // Axis-aligned bounding box
-struct AABB {
-    glm::vec3 center{0.0f};
-    glm::vec3 halfSize{1.0f};
-    bool contains(const glm::vec3& p) const {
-        glm::vec3 d = glm::abs(p - center);
-        return (d.x <= halfSize.x && d.y <= halfSize.y && d.z <= halfSize.z);
+template <typename T, int D>
+struct BasicAABB {
+    glm::vec<D, T> center{T(0)};
+    glm::vec<D, T> halfSize{T(1)};
+    bool contains(const glm::vec<D, T>& p) const {
+        return glm::all(glm::lessThanEqual(glm::abs(p - center), halfSize));
     }
 };
 
-class OctreeNode {
+// Octree node, a quadtree node in 2D. Nodes live in the per-thread frame
+// arenas of their BarnesHut and are released wholesale on the next build.
+template <typename T, int D>
+class BasicOctreeNode {
 public:
-    AABB box;
-    glm::vec3 com{0.0f}; // center of mass
-    float mass{0.0f};
-    std::vector<int> indices; // particle indices for leaf
-    std::unique_ptr<OctreeNode> children[8];
-
-    bool isLeaf() const {
-        for (const auto& c : children) if (c) return false; return true;
-    }
+    static constexpr int kChildren = 1 << D;
+    BasicAABB<T, D> box;
+    glm::vec<D, T> com{T(0)}; // center of mass
+    T mass{0};
+    // Charge as two monopoles, positive and negative, each at its own centre:
+    // a neutral node still exerts its dipole field
+    T qPos{0}, qNeg{0}; // qNeg <= 0
+    glm::vec<D, T> cPos{T(0)}, cNeg{T(0)};
+    int first{0}; // leaf: range [first, first + count) of BarnesHut::order
+    int count{0};
+    BasicOctreeNode* children[kChildren]{};
+    bool leaf{true};
+
+    bool isLeaf() const { return leaf; }
 };
 
+using AABB = BasicAABB<float, 3>;
+using OctreeNode = BasicOctreeNode<float, 3>;
+
+// Distance along the ray (dir normalized) to the particle grown by pickRadius,
+// or a negative value on a miss; dead particles are never hit
+template <typename T, int D>
+inline T particleRayHit(const BasicParticle<T, D>& p, const glm::vec<D, T>& origin, const glm::vec<D, T>& dir, T pickRadius) {
+    if (isDead(p)) return T(-1);
+    glm::vec<D, T> oc = p.position - origin;
+    T along = glm::dot(oc, dir);
+    T r = p.radius + pickRadius;
+    T perp2 = glm::dot(oc, oc) - along * along;
+    if (perp2 > r * r) return T(-1);
+    T t = along - std::sqrt(r * r - perp2);
+    return (t < T(0)) ? along : t; // origin inside the pick sphere
+}
+
 struct BarnesHutParams {
+    // Tolerances and constants, widened to the scalar type of the tree
     float theta = 0.7f; // opening angle
     float softening = 0.01f; // gravitational softening
     float G = 1.0f; // gravitational constant (scaled)
+    float coulombK = 0.0f; // Coulomb constant; 0 = charges ignored by the force walk
+    SofteningKernel kernel = SofteningKernel::Plummer;
+    OpeningCriterion opening = OpeningCriterion::Geometric;
+    float accelTolerance = 0.0025f; // alpha of the relative-acceleration criterion
+    // TreePM short range: pair forces scaled by the erfc split at scale r_s, minimum
+    // images in a periodic cube of this side (0 = open); splitScale 0 = plain gravity
+    float splitScale = 0.0f;
+    float periodicBox = 0.0f;
     int maxLeafSize = 8;
+    int buildTaskCutoff = 4096; // subtrees larger than this are built as OpenMP tasks
+    // > 0: interaction lists cached per group of at most this many tree
+    // particles and kept across refits (float 3D Plummer gravity without
+    // charges or split, geometric or Salmon-Warren opening); 0 = off
+    int listGroupSize = 0;
+};
+
+// Traversal counter policies for BarnesHut::computeForce. NoTraversalStats
+// compiles to nothing; TraversalCounters is kept per thread and merged once.
+struct NoTraversalStats {
+    void onOpen() {}
+    void onParticle() {}
+    void onCell() {}
+};
+
+struct TraversalCounters {
+    uint64_t nodesOpened = 0;
+    uint64_t particleInteractions = 0;
+    uint64_t cellInteractions = 0;
+    void onOpen() { ++nodesOpened; }
+    void onParticle() { ++particleInteractions; }
+    void onCell() { ++cellInteractions; }
+    TraversalCounters& operator+=(const TraversalCounters& o) {
+        nodesOpened += o.nodesOpened;
+        particleInteractions += o.particleInteractions;
+        cellInteractions += o.cellInteractions;
+        return *this;
+    }
+};
+
+// Shape of the last built tree plus traversal counters of the last force pass
+struct TreeStats {
+    static constexpr int kOccupancyBins = 65; // leaves holding 0..63 particles, last bin = 64+
+    size_t nodes = 0;
+    size_t leaves = 0;
+    int maxDepth = 0;
+    double meanLeafDepth = 0.0;
+    size_t leafOccupancy[kOccupancyBins] = {};
+    size_t memoryUsed = 0;     // bytes of nodes + index permutation in use
+    size_t memoryReserved = 0; // bytes retained by arenas and buffers
+    size_t lists = 0;          // cached interaction lists (BarnesHutParams::listGroupSize)
+    size_t listsRewalked = 0;  // of those, walked again by the last build or refit
+    TraversalCounters traversal;
+    size_t particlesWalked = 0;
+
+    double perParticle(uint64_t v) const { return particlesWalked ? (double)v / (double)particlesWalked : 0.0; }
 };
 
-class BarnesHut {
+// Barnes-Hut tree over BasicParticle<T, D>: an octree in 3D, a quadtree in 2D.
+// Explicitly instantiated for float and double in 2 and 3 dimensions.
+template <typename T, int D>
+class BasicBarnesHut {
 public:
-    BarnesHut(BarnesHutParams params = {}): params(params) {}
-    void build(const std::vector<Particle>& particles);
-    glm::vec3 computeForce(int i, const std::vector<Particle>& particles) const;
+    using Vec = glm::vec<D, T>;
+    using Node = BasicOctreeNode<T, D>;
+    using Box = BasicAABB<T, D>;
+    using Particles = BasicParticleArray<T, D>;
+    static constexpr int kMaxDepth = 32;
+    static constexpr int kStackSize = Node::kChildren * (kMaxDepth + 2); // DFS pops one node and pushes at most kChildren per level
+    static constexpr float kSplitCutoff = 4.5f; // short-range walk radius in r_s, as in GADGET-2 (split factor ~0.018 there)
+
+    BasicBarnesHut(BarnesHutParams p = {}) { setParams(p); }
+    void setParams(const BarnesHutParams& p);
+    // Tracers and heavy bodies (see inTree) are left out of the tree and
+    // listed after it in particleOrder(); forces on them are still computed
+    // against the tree. Heavy bodies are the caller's to sum directly.
+    void build(const Particles& particles);
+    // Called from inside a parallel region, either build runs on the calling
+    // thread and hands its subtree tasks to the enclosing team.
+    // This one shapes the tree by positions (one per slot) instead of the
+    // particles' own, which are not read, so other threads may still move the
+    // particles: e.g. predicted positions for the next step. Masses, charges
+    // and flags come from particles. Refit with the actual positions before
+    // walking it; interaction lists are walked by that refit.
+    void build(const Particles& particles, const Vec* positions);
+    // Recomputes boxes and moments bottom-up for the current positions, keeping
+    // the topology of the last build. The particle count must not have changed.
+    // Cached interaction lists are revalidated: each accepted node is tested
+    // again against the refitted group and node boxes, and a list is walked
+    // anew only if one of them fails.
+    void refit(const Particles& particles);
+    // Copies the tree particles' positions, masses and charges into the arrays
+    // the float 3D walks read (build and refit do it themselves); for steps
+    // that neither build nor refit
+    void refreshSources(const Particles& particles);
+    // Acceleration of particle i: gravity plus, with coulombK set, the Coulomb
+    // force over its mass. Tree particles only; the caller adds the rest.
+    // accelOld is |a| of the previous step, used by the relative-acceleration
+    // criterion (0 = unknown). The walk instance for the kernel and criterion
+    // was chosen by setParams; float 3D Plummer gravity without charges or
+    // split runs on the SimdKernels of this CPU. In float 3D only particle i
+    // itself is read: other tree particles come from the copies taken at build,
+    // refit or refreshSources, so the caller may move them during the walk.
+    Vec computeForce(int i, const Particles& particles, T accelOld = T(0)) const {
+        NoTraversalStats none;
+        return computeForce(i, particles, none, accelOld);
+    }
+    // Instantiated for NoTraversalStats and TraversalCounters
+    template <typename Stats>
+    Vec computeForce(int i, const Particles& particles, Stats& stats, T accelOld = T(0)) const;
+
+    // Fills the structural part of stats (nodes, depth, occupancy, memory)
+    void collectStructure(TreeStats& stats) const;
+    // Cached interaction lists, and how many the last build or refit walked
+    int listCount() const { return listed ? listGroups : 0; }
+    int listsRewalked() const { return rewalked; }
+
+    // Bytes held by the tree (node arenas, index permutation, interaction lists), retained across builds
+    size_t memoryBytes() const;
+
+    // Nearest particle hit by the ray origin + t * dir (dir normalized), each
+    // particle taken as a sphere of its radius + pickRadius. Nodes are visited
+    // front to back with slab tests and pruned past the best hit; at most
+    // nodeBudget nodes are opened. Returns -1 if nothing was hit.
+    int raycast(const Particles& particles, const Vec& origin, const Vec& dir, T pickRadius,
+                T maxParticleRadius, int nodeBudget, T* tHit = nullptr) const;
+    // Calls f(index) for every particle within radius of center; particles
+    // outside the tree are tested one by one after it
+    template <typename F>
+    void forEachInSphere(const Particles& particles, const Vec& center, T radius, F&& f) const;
+
+    // Read access for spatial queries: every node owns particleOrder()[first, first + count);
+    // particles outside the tree follow in [treeCount(), builtCount())
+    const Node* getRoot() const { return root; }
+    const int* particleOrder() const { return order.data(); }
+    int treeCount() const { return treeSize; }
+    int builtCount() const { return (int)order.size(); }
 
 private:
-    std::unique_ptr<OctreeNode> root;
+    Node* root = nullptr;
     BarnesHutParams params;
+    // Particle indices permuted so every node owns a contiguous range
+    std::vector<int, FirstTouchAllocator<int>> order;
+    int treeSize = 0; // tree particles: order[0, treeSize)
+    std::vector<FrameArena> arenas; // one per OpenMP thread
+    // blocks an arena left unused, for threads that get more subtrees than
+    // the last build gave them; on the heap so moving the tree keeps it in place
+    std::unique_ptr<FrameArena::Pool> arenaPool = std::make_unique<FrameArena::Pool>();
+
+    // float 3D: tree particles in tree order, structure of arrays for
+    // SimdKernels::gravity and the leaf sums of the scalar walks
+    static constexpr bool kSourceArrays = std::is_same_v<T, float> && D == 3;
+    struct { std::vector<float> x, y, z, m, q; } sources;
 
-    std::unique_ptr<OctreeNode> buildRecursive(const std::vector<Particle>& particles, const AABB& bounds, const std::vector<int>& indices, int depth);
-    void accumulateMass(OctreeNode* node, const std::vector<Particle>& particles);
+    // One per group: a node of at most listGroupSize tree particles whose
+    // parent holds more. Every node the walk accepts is well separated from
+    // the whole group box, so each member may sum the list as its own walk.
+    struct InteractionList {
+        const Node* group = nullptr;
+        std::vector<const Node*> cellNodes; // accepted nodes, monopoles in cx..cm
+        std::vector<float> cx, cy, cz, cm;
+        std::vector<int> leafFirst, leafCount; // opened leaves, merged when adjacent in tree order
+    };
+    bool listed = false; // lists in use: listGroupSize > 0 and a walk that can take them
+    // lists[0, listGroups) are in use; the rest keep their storage for later builds
+    std::vector<InteractionList> lists;
+    int listGroups = 0;
+    // every walk reserves this much: groups change at each build, so lists are
+    // kept at the longest seen (plus headroom) rather than growing one by one
+    size_t listCellCap = 0, listLeafCap = 0;
+    std::vector<int> listOf; // slot -> list, -1 outside the tree
+    int rewalked = 0;
+    bool listsPending = false; // built at given positions: the next refit walks every list
+
+    static constexpr int kSplitTableSize = 1024;
+    std::vector<T> splitTable; // split factor over [0, kSplitCutoff] r_s
+
+    template <typename Stats>
+    using WalkFn = Vec (BasicBarnesHut::*)(int, const Particles&, Stats&, T) const;
+    WalkFn<NoTraversalStats> walkPlain = nullptr;
+    WalkFn<TraversalCounters> walkCounted = nullptr;
+
+    template <bool Split, typename Kernel, typename Opening, typename Stats>
+    Vec walk(int i, const Particles& particles, Stats& stats, T accelOld) const;
+    template <typename Opening, typename Stats>
+    Vec walkVectorized(int i, const Particles& particles, Stats& stats, T accelOld) const;
+    template <typename Opening, typename Stats>
+    Vec walkListed(int i, const Particles& particles, Stats& stats, T accelOld) const;
+    void updateLists(bool rebuilt);
+    template <typename Opening>
+    void updateListsWith(bool rebuilt);
+    template <typename Opening>
+    void walkList(InteractionList& list) const;
+    void reserveList(InteractionList& list) const;
+    template <typename Stats>
+    static WalkFn<Stats> selectWalk(const BarnesHutParams& p);
+    template <typename Position>
+    void buildAt(const Particles& particles, const Position& position, bool walkLists);
+    template <typename Position>
+    Node* buildRecursive(const Particles& particles, const Position& position, const Box& bounds, int first, int count, int depth);
+    void refitRecursive(const Particles& particles, Node* node);
 };
+
+using BarnesHut = BasicBarnesHut<float, 3>;
+
+template <typename T, int D>
+template <typename F>
+void BasicBarnesHut<T, D>::forEachInSphere(const Particles& particles, const Vec& center, T radius, F&& f) const {
+    const T r2 = radius * radius;
+    const Node* stack[kStackSize];
+    int top = 0;
+    if (root) stack[top++] = root;
+    while (top > 0) {
+        const Node* node = stack[--top];
+        Vec gap = glm::max(glm::abs(center - node->box.center) - node->box.halfSize, Vec(T(0)));
+        if (glm::dot(gap, gap) > r2) continue;
+        if (!node->isLeaf()) {
+            for (const Node* c : node->children) if (c) stack[top++] = c;
+            continue;
+        }
+        for (int k = node->first; k < node->first + node->count; ++k) {
+            Vec d = particles[order[k]].position - center;
+            if (glm::dot(d, d) <= r2) f(order[k]);
+        }
+    }
+    for (int k = treeSize; k < (int)order.size(); ++k) {
+        Vec d = particles[order[k]].position - center;
+        if (glm::dot(d, d) <= r2) f(order[k]);
+    }
+}
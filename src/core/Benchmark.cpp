@@ -0,0 +1,271 @@
+#include "Benchmark.h"
+#include "PageAllocator.h"
+#include "Regularization.h"
+#include "SimdKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtx/norm.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static double directSumError(SimulationEngine& sim, const SimulationSettings& s, int samples);
+
+static const char* kModuleNames[] = {"galaxy", "blackhole", "supernova", "interactions", "box"};
+
+const char* moduleName(SimulationModule m) { return kModuleNames[(int)m]; }
+
+bool parseModuleName(const char* name, SimulationModule& out) {
+    for (int i = 0; i < (int)(sizeof(kModuleNames) / sizeof(kModuleNames[0])); ++i) {
+        if (std::strcmp(name, kModuleNames[i]) == 0) { out = (SimulationModule)i; return true; }
+    }
+    return false;
+}
+
+void printTreeStats(const TreeStats& st) {
+    printf("tree: nodes=%zu leaves=%zu depth max=%d mean=%.2f memory used=%.1f KB reserved=%.1f KB\n",
+           st.nodes, st.leaves, st.maxDepth, st.meanLeafDepth, st.memoryUsed / 1024.0, st.memoryReserved / 1024.0);
+    printf("per particle: nodes opened=%.1f particle-particle=%.1f particle-cell=%.1f\n",
+           st.perParticle(st.traversal.nodesOpened), st.perParticle(st.traversal.particleInteractions),
+           st.perParticle(st.traversal.cellInteractions));
+    if (st.lists > 0) printf("interaction lists: %zu, %zu walked by the last build or refit\n", st.lists, st.listsRewalked);
+    printf("leaf occupancy:");
+    for (int b = 0; b < TreeStats::kOccupancyBins; ++b) {
+        if (!st.leafOccupancy[b]) continue;
+        printf(" %d%s:%zu", b, (b == TreeStats::kOccupancyBins - 1) ? "+" : "", st.leafOccupancy[b]);
+    }
+    printf("\n");
+}
+
+bool reportAllocationCheck(const AllocationCounters (&totals)[(int)FramePhase::Count], bool strict) {
+    bool clean = true;
+    for (int p = 0; p < (int)FramePhase::Count; ++p) {
+        if (totals[p].count == 0) continue;
+        bool fatal = strict || (FramePhase)p != FramePhase::Other;
+        if (fatal) clean = false;
+        printf("%-11s %8llu allocations %12llu bytes%s\n", framePhaseName((FramePhase)p),
+               (unsigned long long)totals[p].count, (unsigned long long)totals[p].bytes, fatal ? "  <-- steady state" : "");
+    }
+    printf("allocation check: %s\n", clean ? "PASS" : "FAIL");
+    return clean;
+}
+
+int runBenchmark(const BenchmarkOptions& opts) {
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    SimulationEngine sim;
+    sim.reset(opts.settings);
+    for (int i = 0; i < opts.warmupSteps; ++i) sim.update(opts.settings);
+
+    FrameProfile sum;
+    double particleSteps = 0.0;
+    AllocationCounters allocTotals[(int)FramePhase::Count];
+    AllocationTracker::beginFrame(); // drops what setup and warm-up allocated
+    for (int i = 0; i < opts.steps; ++i) {
+        sim.update(opts.settings);
+        if (opts.allocationProbe) {
+            // the block a tree arena takes when it outgrows the ones it kept:
+            // mapped pages, which never pass through operator new
+            AllocationTracker::PhaseScope phase(FramePhase::Build);
+            PageAllocator::release(PageAllocator::allocate(256 * 1024, false));
+        }
+        AllocationTracker::beginFrame();
+        for (int p = 0; p < (int)FramePhase::Count; ++p) {
+            AllocationCounters c = AllocationTracker::lastFrame((FramePhase)p);
+            allocTotals[p].count += c.count; allocTotals[p].bytes += c.bytes;
+        }
+        const FrameProfile& f = sim.getProfile();
+        for (int p = 0; p < (int)FramePhase::Count; ++p) {
+            sum.phases[p].ms += f.phases[p].ms;
+            sum.phases[p].counters += f.phases[p].counters;
+        }
+        particleSteps += (double)f.particles;
+    }
+    const double steps = (double)std::max(1, opts.steps);
+    const bool counters = sim.getPerfCounters().available();
+
+    printf("module=%s particles=%zu steps=%d threads=%d gravity=%s %dD simd=%s\n", moduleName(opts.settings.module),
+           sim.getParticles().size(), opts.steps, threads,
+           opts.settings.precision == ScalarPrecision::Double ? "double" : "float", opts.settings.dimensions == 2 ? 2 : 3,
+           simdKernels().name);
+    const SolverProfile& solver = sim.getSolverProfile();
+    printf("solver: %s, leaf %d, task cutoff %d, force chunk ", sim.solverProfileLoaded() ? SolverProfile::kDefaultPath : "defaults",
+           solver.maxLeafSize, solver.buildTaskCutoff);
+    if (sim.forceChunk() > 0) printf("%d\n", sim.forceChunk());
+    else printf("static (particle pages on several NUMA nodes)\n");
+    printf("%-11s %10s %7s %14s %14s\n", "phase", "ms/step", "IPC", "LLC miss/part", "br miss/part");
+    PerfSample total;
+    for (int p = 0; p < (int)FramePhase::Count; ++p) {
+        const PhaseStats& st = sum.phases[p];
+        if (st.ms <= 0.0) continue;
+        total += st.counters;
+        if (counters) {
+            printf("%-11s %10.3f %7.2f %14.3f %14.3f\n", framePhaseName((FramePhase)p), st.ms / steps, st.counters.ipc(),
+                   st.counters.llcMisses / particleSteps, st.counters.branchMisses / particleSteps);
+        } else {
+            printf("%-11s %10.3f %7s %14s %14s\n", framePhaseName((FramePhase)p), st.ms / steps, "-", "-", "-");
+        }
+    }
+    printf("%-11s %10.3f", "total", sum.totalMs() / steps);
+    if (counters) printf(" %7.2f %14.3f %14.3f", total.ipc(), total.llcMisses / particleSteps, total.branchMisses / particleSteps);
+    printf("\n");
+    if (opts.settings.hardwareCounters) printf("hardware counters: %s\n", sim.getPerfCounters().status().c_str());
+    if (opts.settings.treeStats) printTreeStats(sim.getTreeStats());
+    if (opts.checkSamples > 0) {
+        printf("force error vs direct sum: %.4f%% (%d samples, theta %.2f)\n",
+               directSumError(sim, opts.settings, opts.checkSamples) * 100.0, opts.checkSamples, opts.settings.theta);
+    }
+    if (opts.checkAllocations && !reportAllocationCheck(allocTotals, true)) return 1;
+    return 0;
+}
+
+int runRegularizationCheck(int stepsPerOrbit) {
+    const float kSizes[] = { 0.05f, 1.0f, 20.0f };
+    const float kEccentricities[] = { 0.0f, 0.9f };
+    const float mu = 1.0f;
+    bool ok = true;
+    printf("regularization: %d sub-steps per orbit\n", stepsPerOrbit);
+    printf("%8s %6s %10s %12s\n", "a", "e", "sub-steps", "closure");
+    for (float a : kSizes) {
+        for (float e : kEccentricities) {
+            // start at apocentre, advance one period
+            glm::vec3 r(a * (1.0f + e), 0.0f, 0.0f);
+            glm::vec3 v(0.0f, std::sqrt(mu / a * (1.0f - e) / (1.0f + e)), 0.0f);
+            const glm::vec3 r0 = r;
+            const float period = 2.0f * glm::pi<float>() * std::sqrt(a * a * a / mu);
+            const int steps = advanceRegularizedPair(r, v, mu, glm::vec3(0.0f), period, stepsPerOrbit, 100 * stepsPerOrbit);
+            const float closure = glm::length(r - r0) / a;
+            // the last sub-step is shortened to land on the period; the phase
+            // error of the leapfrog falls as 1 / steps^2
+            const bool pass = std::abs(steps - stepsPerOrbit) <= std::max(2, stepsPerOrbit / 10)
+                           && closure < 50.0f / ((float)stepsPerOrbit * stepsPerOrbit);
+            printf("%8.2f %6.2f %10d %12.2e%s\n", a, e, steps, closure, pass ? "" : "  <-- off");
+            ok = ok && pass;
+        }
+    }
+    printf("regularization check: %s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+// Mean relative force error of the solver against direct summation on a
+// strided sample of particles, both at the current positions
+static double directSumError(SimulationEngine& sim, const SimulationSettings& s, int samples) {
+    const ParticleArray& pts = sim.getParticles();
+    const int n = (int)pts.size();
+    if (n < 2) return 0.0;
+    const int stride = std::max(1, n / std::max(1, samples));
+    std::vector<int> slots;
+    for (int i = 0; i < n; i += stride) slots.push_back(i);
+    std::vector<glm::vec3> accel;
+    sim.sampleAccelerations(s, slots, accel);
+    const float eps2 = s.softening * s.softening;
+    double errSum = 0.0, refSum = 0.0;
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:errSum, refSum)
+    for (int k = 0; k < (int)slots.size(); ++k) {
+        const int i = slots[k];
+        const Particle& pi = pts[i];
+        if (isDead(pi)) continue;
+        glm::dvec3 ref(0.0), field(0.0);
+        for (int j = 0; j < n; ++j) {
+            if (j == i || isTracer(pts[j])) continue;
+            glm::dvec3 r = glm::dvec3(pts[j].position - pi.position);
+            double d2 = glm::dot(r, r) + eps2;
+            double invDist3 = 1.0 / (d2 * std::sqrt(d2));
+            ref += (double)s.gravityG * pts[j].mass * invDist3 * r;
+            if (inTree(pts[j])) field -= (double)pts[j].charge * invDist3 * r;
+        }
+        ref += glm::dvec3(backgroundAccel(s.background, s.gravityG, s.softening, pi.position));
+        ref *= (double)pi.mass;
+        ref += (double)s.coulombK * pi.charge * field;
+        errSum += glm::length((double)pi.mass * glm::dvec3(accel[k]) - ref);
+        refSum += glm::length(ref);
+    }
+    return refSum > 0.0 ? errSum / refSum : 0.0;
+}
+
+namespace {
+struct Trial {
+    double ms = 0.0;    // build + force, fastest of the repeats
+    double error = 0.0;
+};
+}
+
+static Trial measureProfile(SimulationEngine& sim, const SimulationSettings& s, const SolverProfile& p, const AutotuneOptions& opts) {
+    sim.setSolverProfile(p);
+    sim.update(s); // rebuilds with the new parameters and grows the arenas
+    Trial t;
+    t.ms = 1e30;
+    for (int r = 0; r < std::max(1, opts.repeats); ++r) {
+        sim.update(s);
+        const FrameProfile& f = sim.getProfile();
+        t.ms = std::min(t.ms, f[FramePhase::Build].ms + f[FramePhase::Force].ms);
+    }
+    t.error = directSumError(sim, s, opts.samples);
+    return t;
+}
+
+int runAutotune(const AutotuneOptions& opts) {
+    // Zero timestep: particles stay put, so every force pass sees the same configuration
+    SimulationSettings s = opts.settings;
+    s.timeStep = 0.0f;
+    s.rebuildEveryN = 1;
+    s.collisions = false;
+    s.toolEngaged = false;
+    s.hardwareCounters = false;
+    s.treeStats = false;
+    SimulationEngine sim;
+    sim.reset(s);
+
+    SolverProfile best = sim.getSolverProfile();
+    Trial bestTrial = measureProfile(sim, s, best, opts);
+    printf("autotune: module=%s particles=%zu theta=%.2f target error=%.3f%%\n", moduleName(s.module),
+           sim.getParticles().size(), s.theta, opts.targetError * 100.0);
+    printf("start: leaf=%d cutoff=%d chunk=%d  %.3f ms  error %.3f%%\n", best.maxLeafSize, best.buildTaskCutoff,
+           best.forceChunk, bestTrial.ms, bestTrial.error * 100.0);
+
+    struct Knob { const char* name; int SolverProfile::*field; std::vector<int> values; };
+    const Knob knobs[] = {
+        {"maxLeafSize", &SolverProfile::maxLeafSize, {4, 8, 12, 16, 24, 32}},
+        {"buildTaskCutoff", &SolverProfile::buildTaskCutoff, {1024, 2048, 4096, 8192, 16384}},
+        {"forceChunk", &SolverProfile::forceChunk, {16, 64, 256, 1024}},
+    };
+    bool haveValid = bestTrial.error <= opts.targetError;
+    for (const Knob& k : knobs) {
+        for (int v : k.values) {
+            if (v == best.*k.field) continue;
+            SolverProfile cand = best;
+            cand.*k.field = v;
+            Trial t = measureProfile(sim, s, cand, opts);
+            bool ok = t.error <= opts.targetError;
+            printf("  %-16s %6d  %9.3f ms  error %.3f%%%s\n", k.name, v, t.ms, t.error * 100.0, ok ? "" : "  rejected");
+            if (ok && (!haveValid || t.ms < bestTrial.ms)) { best = cand; bestTrial = t; haveValid = true; }
+        }
+    }
+
+    if (!haveValid) {
+        printf("no configuration reaches the target error (theta %.2f is probably too wide); profile not written\n", s.theta);
+        return 1;
+    }
+#ifdef _OPENMP
+    best.threads = omp_get_max_threads();
+#else
+    best.threads = 1;
+#endif
+    best.theta = s.theta;
+    best.forceError = bestTrial.error;
+    best.stepMs = bestTrial.ms;
+    printf("best: leaf=%d cutoff=%d chunk=%d  %.3f ms  error %.3f%%\n", best.maxLeafSize, best.buildTaskCutoff,
+           best.forceChunk, best.stepMs, best.forceError * 100.0);
+    if (!best.save(opts.path)) {
+        fprintf(stderr, "cannot write %s\n", opts.path);
+        return 1;
+    }
+    printf("wrote %s\n", opts.path);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "SimulationEngine.h"
+#include "AllocationTracker.h"
+
+struct BenchmarkOptions {
+    SimulationSettings settings;
+    int warmupSteps = 5;
+    int steps = 50;
+    int checkSamples = 0; // > 0: report the force error against direct summation on this many particles
+    bool checkAllocations = false; // fail if a timed step allocates (needs COSMOS_TRACK_ALLOCATIONS)
+    bool allocationProbe = false;  // take an arena-sized page block in every timed step, which the check must catch
+};
+
+// Runs the simulation headless (no window/GL) and prints per-phase averages:
+// wall time, and with settings.hardwareCounters IPC and misses per particle.
+// Returns a process exit code.
+int runBenchmark(const BenchmarkOptions& opts);
+
+struct AutotuneOptions {
+    SimulationSettings settings; // scene to tune on (module, particle count, theta)
+    double targetError = 0.01;   // mean relative force error against direct summation
+    int samples = 256;           // particles checked against direct summation
+    int repeats = 3;             // timed steps per candidate, fastest kept
+    const char* path = SolverProfile::kDefaultPath;
+};
+
+// Searches maxLeafSize, the parallel build cutoff and the force chunk size one
+// at a time, starting from the current profile, and writes the fastest
+// configuration within the error target. Candidates over the target are
+// rejected; if none qualifies nothing is written and 1 is returned.
+int runAutotune(const AutotuneOptions& opts);
+
+// Advances Kepler orbits of several sizes and eccentricities over one period
+// with advanceRegularizedPair and checks that each takes about stepsPerOrbit
+// sub-steps and closes. Prints one line per orbit; returns a process exit code.
+int runRegularizationCheck(int stepsPerOrbit);
+
+void printTreeStats(const TreeStats& stats);
+// Prints the allocations of a check run per phase and whether it passed. Any
+// phase but FramePhase::Other fails it; with strict (headless runs, where only
+// the engine runs) Other does too.
+bool reportAllocationCheck(const AllocationCounters (&totals)[(int)FramePhase::Count], bool strict);
+
+const char* moduleName(SimulationModule m);
+bool parseModuleName(const char* name, SimulationModule& out);
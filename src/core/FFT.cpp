@@ -0,0 +1,62 @@
+#include "FFT.h"
+#include <cmath>
+#include <utility>
+#include <glm/gtc/constants.hpp>
+
+void FFT3D::resize(int size) {
+    if (size == n) return;
+    n = size;
+    twiddles.resize(n / 2);
+    for (int k = 0; k < n / 2; ++k) {
+        double a = -2.0 * glm::pi<double>() * k / n;
+        twiddles[k] = Complex((float)std::cos(a), (float)std::sin(a));
+    }
+    int bits = 0;
+    while ((1 << bits) < n) ++bits;
+    bitReverse.resize(n);
+    for (int i = 0; i < n; ++i) {
+        int r = 0;
+        for (int b = 0; b < bits; ++b) if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+        bitReverse[i] = r;
+    }
+}
+
+void FFT3D::line(Complex* data, long stride, bool inverse) const {
+    for (int i = 0; i < n; ++i) {
+        int j = bitReverse[i];
+        if (i < j) std::swap(data[i * stride], data[j * stride]);
+    }
+    for (int len = 2; len <= n; len <<= 1) {
+        const int half = len / 2, step = n / len;
+        for (int i = 0; i < n; i += len) {
+            for (int k = 0; k < half; ++k) {
+                Complex w = inverse ? std::conj(twiddles[k * step]) : twiddles[k * step];
+                Complex& a = data[(i + k) * stride];
+                Complex& b = data[(i + k + half) * stride];
+                Complex v = b * w;
+                b = a - v;
+                a += v;
+            }
+        }
+    }
+}
+
+void FFT3D::transform(Complex* grid, bool inverse) const {
+    const long n2 = (long)n * n;
+    // x: contiguous lines
+    #pragma omp parallel for schedule(static)
+    for (long l = 0; l < n2; ++l) line(grid + l * n, 1, inverse);
+    // y: one plane per iteration stays in cache
+    #pragma omp parallel for schedule(static)
+    for (int z = 0; z < n; ++z) {
+        for (int x = 0; x < n; ++x) line(grid + z * n2 + x, n, inverse);
+    }
+    // z
+    #pragma omp parallel for schedule(static)
+    for (long l = 0; l < n2; ++l) line(grid + l, n2, inverse);
+    if (inverse) {
+        const float scale = 1.0f / (float)(n2 * n);
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < n2 * n; ++i) grid[i] *= scale;
+    }
+}
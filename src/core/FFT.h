@@ -0,0 +1,24 @@
+#pragma once
+#include <complex>
+#include <vector>
+
+// In-place complex FFT of an n^3 grid (x fastest, n a power of two).
+// Radix-2 Cooley-Tukey along each axis, lines transformed in parallel.
+// forward() is unnormalized; inverse() divides by n^3.
+class FFT3D {
+public:
+    using Complex = std::complex<float>;
+
+    void resize(int n);
+    int size() const { return n; }
+    void forward(Complex* grid) { transform(grid, false); }
+    void inverse(Complex* grid) { transform(grid, true); }
+
+private:
+    int n = 0;
+    std::vector<Complex> twiddles; // exp(-2 pi i k / n), k < n / 2
+    std::vector<int> bitReverse;
+
+    void transform(Complex* grid, bool inverse) const;
+    void line(Complex* data, long stride, bool inverse) const;
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <cmath>
+#include <glm/glm.hpp>
+
+// Force-walk policies. BarnesHut instantiates its walk once per combination and
+// picks the instance when its parameters change, so the inner loop never
+// branches on them.
+
+enum class SofteningKernel {
+    Plummer,     // 1 / (r^2 + eps^2)^(3/2) everywhere
+    CubicSpline, // Monaghan-Lattanzio spline, Newtonian beyond 2.8 eps
+    Compact      // polynomial core, Newtonian beyond 2 eps
+};
+
+enum class OpeningCriterion {
+    Geometric,           // size / d < theta
+    SalmonWarren,        // d > size / theta + |com - centre|
+    RelativeAcceleration // G M size^2 / d^4 < alpha |a_old|, as in GADGET-2
+};
+
+// Kernels return the factor f(r) with acceleration G m f(r) r; r2 is unsoftened
+struct PlummerSoftening {
+    template <typename T>
+    static T invCube(T r2, T eps2) {
+        T invDist = T(1) / std::sqrt(r2 + eps2);
+        return invDist * invDist * invDist;
+    }
+};
+
+// Spline of support h = 2.8 eps, as deep a potential as Plummer eps (GADGET-2 convention)
+struct CubicSplineSoftening {
+    template <typename T>
+    static T invCube(T r2, T eps2) {
+        const T h2 = T(7.84) * eps2;
+        if (r2 >= h2) {
+            T invDist = T(1) / std::sqrt(r2);
+            return invDist * invDist * invDist;
+        }
+        const T hInv = T(1) / std::sqrt(h2), hInv3 = hInv * hInv * hInv;
+        const T u = std::sqrt(r2) * hInv;
+        if (u < T(0.5)) return hInv3 * (T(32.0 / 3.0) + u * u * (T(32) * u - T(38.4)));
+        return hInv3 * (T(64.0 / 3.0) - T(48) * u + T(38.4) * u * u - T(32.0 / 3.0) * u * u * u - T(1.0 / 15.0) / (u * u * u));
+    }
+};
+
+// Source spread as density (1 - r^2 / h^2) within h = 2 eps: enclosed mass
+// (5/2 x^3 - 3/2 x^5), so the core needs no square root
+struct CompactSoftening {
+    template <typename T>
+    static T invCube(T r2, T eps2) {
+        const T h2 = T(4) * eps2;
+        if (r2 >= h2) {
+            T invDist = T(1) / std::sqrt(r2);
+            return invDist * invDist * invDist;
+        }
+        const T hInv2 = T(1) / h2;
+        return (T(2.5) - T(1.5) * r2 * hInv2) * hInv2 * std::sqrt(hInv2);
+    }
+};
+
+// Per-walk inputs of the opening test
+template <typename T>
+struct OpeningContext {
+    T theta;
+    T accelTolerance; // alpha |a_old| / G; 0 = no previous acceleration
+};
+
+// Opening tests: true when node may be used as a single monopole; r is the
+// (minimum image) separation com - position, dist its length and size the
+// node's widest extent
+struct GeometricOpening {
+    template <typename Node, typename T, int D>
+    static bool accept(const Node&, const glm::vec<D, T>&, T dist, T size, const OpeningContext<T>& c) {
+        return size < c.theta * dist;
+    }
+};
+
+// The offset between centre of mass and box centre widens the guard, so
+// lopsided nodes are opened earlier (Salmon & Warren 1994)
+struct SalmonWarrenOpening {
+    template <typename Node, typename T, int D>
+    static bool accept(const Node& node, const glm::vec<D, T>&, T dist, T size, const OpeningContext<T>& c) {
+        return c.theta * (dist - glm::length(node.com - node.box.center)) > size;
+    }
+};
+
+// Accepts when the truncation error estimate G M size^2 / d^4 is below a
+// fraction alpha of the particle's previous acceleration; nodes whose box
+// (grown by 20%) contains the particle are always opened. Without a previous
+// acceleration (first step, spawned particle) it falls back to the geometric test.
+struct RelativeAccelerationOpening {
+    template <typename Node, typename T, int D>
+    static bool accept(const Node& node, const glm::vec<D, T>& r, T dist, T size, const OpeningContext<T>& c) {
+        if (c.accelTolerance <= T(0)) return size < c.theta * dist;
+        if (glm::all(glm::lessThan(glm::abs(r + node.box.center - node.com), node.box.halfSize * T(1.2)))) return false;
+        const T d2 = dist * dist;
+        return node.mass * size * size < c.accelTolerance * d2 * d2;
+    }
+};
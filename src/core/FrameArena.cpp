@@ -0,0 +1,95 @@
+#include "FrameArena.h"
+#include "PageAllocator.h"
+#include <algorithm>
+
+FrameArena::Pool::~Pool() {
+    for (auto& b : blocks) PageAllocator::release(b.data);
+}
+
+size_t FrameArena::Pool::bytesReserved() const {
+    size_t total = 0;
+    for (const auto& b : blocks) total += b.size;
+    return total;
+}
+
+FrameArena::~FrameArena() { releaseAll(); }
+
+FrameArena& FrameArena::operator=(FrameArena&& o) noexcept {
+    if (this == &o) return *this;
+    releaseAll();
+    blocks = std::move(o.blocks);
+    blockIndex = o.blockIndex; offset = o.offset; used = o.used; blockBytes = o.blockBytes; pool = o.pool;
+    o.blocks.clear(); o.blockIndex = 0; o.offset = 0; o.used = 0;
+    return *this;
+}
+
+void FrameArena::releaseAll() {
+    for (auto& b : blocks) PageAllocator::release(b.data);
+    blocks.clear();
+    blockIndex = 0; offset = 0; used = 0;
+}
+
+void FrameArena::reset() {
+    // blocks past the last one bumped went unused this frame
+    const size_t kept = (used > 0) ? blockIndex + 1 : 0;
+    if (pool && kept < blocks.size()) {
+        pool->blocks.insert(pool->blocks.end(), blocks.begin() + kept, blocks.end());
+        blocks.resize(kept);
+    }
+    // taking from the pool then never grows the list
+    if (pool) blocks.reserve(pool->slots);
+    blockIndex = 0; offset = 0; used = 0;
+}
+
+void* FrameArena::allocate(size_t bytes, size_t align) {
+    while (blockIndex < blocks.size()) {
+        Block& b = blocks[blockIndex];
+        size_t aligned = (offset + align - 1) & ~(align - 1);
+        if (aligned + bytes <= b.size) {
+            offset = aligned + bytes;
+            used += bytes;
+            return b.data + aligned;
+        }
+        // current block exhausted: move on to the next retained one
+        ++blockIndex; offset = 0;
+    }
+    // Grow, from the pool first. New pages are touched by the calling (owning)
+    // thread, so per-thread arenas stay NUMA-local without an explicit parallel
+    // first touch; pooled blocks may come from another thread's node.
+    const size_t size = std::max(blockBytes, bytes + align);
+    Block b{ nullptr, 0 };
+    if (pool) {
+        #pragma omp critical(frameArenaPool)
+        if (!pool->blocks.empty() && pool->blocks.back().size >= size) {
+            b = pool->blocks.back();
+            pool->blocks.pop_back();
+        }
+    }
+    if (!b.data) {
+        b = Block{ static_cast<char*>(PageAllocator::allocate(size, false)), size };
+        if (pool) {
+            // with headroom: how subtrees fall on threads varies per frame, so
+            // the block count creeps up for a while before it settles
+            size_t slots;
+            #pragma omp critical(frameArenaPool)
+            {
+                if (++pool->total > pool->slots) {
+                    pool->slots = 2 * pool->total + 16;
+                    pool->blocks.reserve(pool->slots);
+                }
+                slots = pool->slots;
+            }
+            blocks.reserve(slots);
+        }
+    }
+    blocks.push_back(b);
+    blockIndex = blocks.size() - 1;
+    offset = 0;
+    return allocate(bytes, align);
+}
+
+size_t FrameArena::bytesReserved() const {
+    size_t total = 0;
+    for (const auto& b : blocks) total += b.size;
+    return total;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Bump allocator for frame-scoped data (tree nodes, scratch lists).
+// reset() rewinds every block but keeps them, so once the arena has grown to
+// the steady-state working set no further heap allocations happen.
+// Objects are never destroyed individually: only trivially destructible types.
+// Arenas of one owner (one per thread) may share a Pool: reset() hands it the
+// blocks the last frame left unused, and an arena that runs out takes from it
+// before allocating, so work that moves between threads reuses retained blocks.
+class FrameArena {
+    struct Block { char* data; size_t size; };
+
+public:
+    class Pool {
+    public:
+        Pool() = default;
+        ~Pool();
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+        size_t bytesReserved() const;
+    private:
+        friend class FrameArena;
+        std::vector<Block> blocks;
+        size_t total = 0; // blocks made by its arenas
+        size_t slots = 0; // capacity every block list keeps, total plus headroom
+    };
+
+    explicit FrameArena(size_t blockBytes = 256 * 1024): blockBytes(blockBytes) {}
+    ~FrameArena();
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    FrameArena(FrameArena&& o) noexcept { *this = std::move(o); }
+    FrameArena& operator=(FrameArena&& o) noexcept;
+
+    // Arenas of a pool may allocate concurrently; reset() them from one thread
+    void setPool(Pool* p) { pool = p; }
+
+    void* allocate(size_t bytes, size_t align = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocateArray(size_t n) { return static_cast<T*>(allocate(n * sizeof(T), alignof(T))); }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) { return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...); }
+
+    void reset();
+
+    size_t bytesUsed() const { return used; }
+    size_t bytesReserved() const;
+
+private:
+    std::vector<Block> blocks;
+    size_t blockIndex = 0; // block currently bumped
+    size_t offset = 0;     // bump offset inside blocks[blockIndex]
+    size_t used = 0;
+    size_t blockBytes;
+    Pool* pool = nullptr;
+
+    void releaseAll();
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+// Phases of one frame, used to attribute profiling data (allocations, counters, timings)
+enum class FramePhase {
+    Build,
+    Force,
+    Mesh,
+    Tool,
+    Integrate,
+    Collisions,
+    Horizon,
+    Publish,
+    Render,
+    Other,
+    Count
+};
+
+inline const char* framePhaseName(FramePhase p) {
+    switch (p) {
+        case FramePhase::Build: return "build";
+        case FramePhase::Force: return "force";
+        case FramePhase::Mesh: return "mesh";
+        case FramePhase::Tool: return "tool";
+        case FramePhase::Integrate: return "integrate";
+        case FramePhase::Collisions: return "collisions";
+        case FramePhase::Horizon: return "horizon";
+        case FramePhase::Publish: return "publish";
+        case FramePhase::Render: return "render";
+        default: return "other";
+    }
+}
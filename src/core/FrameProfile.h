@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include "FramePhase.h"
+#include "PerfCounters.h"
+
+struct PhaseStats {
+    double ms = 0.0;
+    PerfSample counters; // zero unless hardware counters are enabled
+};
+
+// Per-phase cost of the last SimulationEngine::update
+struct FrameProfile {
+    PhaseStats phases[(int)FramePhase::Count];
+    size_t particles = 0;
+    bool hasCounters = false;
+    int encounters = 0;        // regularized pairs this step
+    int encounterSubsteps = 0; // their sub-steps, summed
+
+    const PhaseStats& operator[](FramePhase p) const { return phases[(int)p]; }
+    PhaseStats& operator[](FramePhase p) { return phases[(int)p]; }
+    double totalMs() const {
+        double t = 0.0;
+        for (const auto& ph : phases) t += ph.ms;
+        return t;
+    }
+};
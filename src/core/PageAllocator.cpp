@@ -0,0 +1,126 @@
+#include "PageAllocator.h"
+#include "AllocationTracker.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Every block carries a small header so release() knows how it was obtained
+struct alignas(64) BlockHeader {
+    size_t mappedBytes;
+    int kind; // 0 = heap, 1 = mmap
+};
+constexpr size_t kHeader = sizeof(BlockHeader);
+constexpr size_t kSmallBlock = 64 * 1024; // below this plain heap is fine
+constexpr size_t kHugePage = 2u * 1024u * 1024u;
+constexpr size_t kTouchStride = 4096;
+
+std::atomic<int> gHugePageMode{(int)HugePageMode::Transparent};
+
+size_t roundUp(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+void firstTouch(char* p, size_t bytes) {
+    // Same static partitioning as the particle loops: thread t touches the
+    // t-th contiguous slice, so the kernel places those pages on t's node.
+    // The force loops only keep it once the pages span several nodes
+    // (SimulationEngine::forceChunk); otherwise they balance dynamically.
+    const long long pages = (long long)((bytes + kTouchStride - 1) / kTouchStride);
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < pages; ++i) {
+        p[(size_t)i * kTouchStride] = 0;
+    }
+}
+} // namespace
+
+void PageAllocator::setHugePageMode(HugePageMode mode) { gHugePageMode.store((int)mode); }
+HugePageMode PageAllocator::getHugePageMode() { return (HugePageMode)gHugePageMode.load(); }
+
+void* PageAllocator::allocate(size_t bytes, bool parallelFirstTouch) {
+    size_t total = bytes + kHeader;
+    char* base = nullptr;
+    int kind = 0;
+
+#if defined(__linux__)
+    if (total >= kSmallBlock) {
+        HugePageMode mode = getHugePageMode();
+        void* m = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+        if (mode == HugePageMode::Explicit && total >= kHugePage) {
+            total = roundUp(total, kHugePage);
+            m = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            // empty hugetlb pool: fall back to transparent huge pages
+            if (m == MAP_FAILED) mode = HugePageMode::Transparent;
+        }
+#endif
+        if (m == MAP_FAILED) {
+            const bool huge = (mode != HugePageMode::Off) && total >= kHugePage;
+            total = roundUp(total, huge ? kHugePage : (size_t)sysconf(_SC_PAGESIZE));
+            m = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#if defined(MADV_HUGEPAGE)
+            if (m != MAP_FAILED && huge) madvise(m, total, MADV_HUGEPAGE);
+#endif
+        }
+        if (m == MAP_FAILED) throw std::bad_alloc();
+        base = static_cast<char*>(m);
+        kind = 1;
+        // heap blocks are counted by the tracker's operator new; mappings are not
+        AllocationTracker::recordExternal(total);
+    }
+#endif
+    if (!base) {
+        base = static_cast<char*>(::operator new(total, std::align_val_t(kHeader)));
+    }
+
+    if (parallelFirstTouch && total >= kSmallBlock) firstTouch(base, total);
+
+    BlockHeader* h = reinterpret_cast<BlockHeader*>(base);
+    h->mappedBytes = total;
+    h->kind = kind;
+    return base + kHeader;
+}
+
+void PageAllocator::release(void* p) {
+    if (!p) return;
+    char* base = static_cast<char*>(p) - kHeader;
+    BlockHeader* h = reinterpret_cast<BlockHeader*>(base);
+#if defined(__linux__)
+    if (h->kind == 1) { munmap(base, h->mappedBytes); return; }
+#endif
+    ::operator delete(base, std::align_val_t(kHeader));
+}
+
+PagePlacementReport PageAllocator::queryPlacement(const void* p, size_t bytes) {
+    PagePlacementReport r;
+#if defined(__linux__) && defined(SYS_move_pages)
+    if (!p || bytes == 0) return r;
+    const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    r.pageSize = pageSize;
+    uintptr_t first = (uintptr_t)p / pageSize * pageSize;
+    size_t pageCount = ((uintptr_t)p + bytes - first + pageSize - 1) / pageSize;
+    // sample evenly; move_pages with nodes == nullptr only queries
+    const size_t samples = std::min<size_t>(pageCount, 1024);
+    std::vector<void*> pages(samples);
+    std::vector<int> status(samples, -1);
+    for (size_t i = 0; i < samples; ++i) {
+        pages[i] = (void*)(first + (i * pageCount / samples) * pageSize);
+    }
+    long rc = syscall(SYS_move_pages, 0, (unsigned long)samples, pages.data(), nullptr, status.data(), 0);
+    r.pagesSampled = samples;
+    if (rc < 0) { r.pagesUnknown = samples; return r; }
+    for (int node : status) {
+        if (node < 0) { ++r.pagesUnknown; continue; }
+        if ((size_t)node >= r.pagesPerNode.size()) r.pagesPerNode.resize(node + 1, 0);
+        ++r.pagesPerNode[node];
+    }
+#else
+    (void)p; (void)bytes;
+#endif
+    return r;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Backing policy for large simulation arrays (particles, tree storage)
+enum class HugePageMode {
+    Off,          // regular pages
+    Transparent,  // madvise(MADV_HUGEPAGE), kernel decides
+    Explicit      // MAP_HUGETLB from the reserved pool, falls back to Transparent
+};
+
+// Where the pages of an allocation physically live (sampled)
+struct PagePlacementReport {
+    size_t pageSize = 0;
+    size_t pagesSampled = 0;
+    size_t pagesUnknown = 0;           // not resident or query unsupported
+    std::vector<size_t> pagesPerNode;  // index = NUMA node
+};
+
+// Page-granular allocator for arrays that are swept by OpenMP static loops.
+// Memory is first-touched in parallel with the same static partitioning the
+// integrate loops (and, on NUMA machines, the force loops) use, so each
+// thread's slice lands on its own NUMA node.
+class PageAllocator {
+public:
+    static void setHugePageMode(HugePageMode mode);
+    static HugePageMode getHugePageMode();
+
+    static void* allocate(size_t bytes, bool parallelFirstTouch);
+    static void release(void* p);
+
+    static PagePlacementReport queryPlacement(const void* p, size_t bytes);
+};
+
+template <typename T>
+class FirstTouchAllocator {
+public:
+    using value_type = T;
+
+    FirstTouchAllocator() noexcept = default;
+    template <typename U> FirstTouchAllocator(const FirstTouchAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) { return static_cast<T*>(PageAllocator::allocate(n * sizeof(T), true)); }
+    void deallocate(T* p, size_t) noexcept { PageAllocator::release(p); }
+
+    template <typename U> bool operator==(const FirstTouchAllocator<U>&) const noexcept { return true; }
+    template <typename U> bool operator!=(const FirstTouchAllocator<U>&) const noexcept { return false; }
+};
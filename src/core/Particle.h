@@ -1,13 +1,54 @@
 #pragma once
+#include <cstdint>
+#include <vector>
 #include <glm/glm.hpp>
+#include "PageAllocator.h"
 
-struct Particle {
-    glm::vec3 position{0.0f};
-    glm::vec3 velocity{0.0f};
-    float mass{1.0f};
-    float radius{1.0f};
+// Particle state in scalar type T and D dimensions (2 or 3). The engine runs
+// on Particle; other instantiations back the double and 2D gravity paths.
+template <typename T, int D>
+struct BasicParticle {
+    using Scalar = T;
+    static constexpr int kDim = D;
+    using Vec = glm::vec<D, T>;
+    Vec position{T(0)};
+    Vec velocity{T(0)};
+    T mass{1};
+    T radius{1};
     glm::vec4 color{1.0f};
-    float charge{0.0f};
-    // Accumulator for integration
-    glm::vec3 force{0.0f};
+    T charge{0};
+    uint32_t flags{0}; // ParticleFlags
 };
+
+using Particle = BasicParticle<float, 3>;
+
+enum ParticleFlags : uint32_t {
+    // Passive tracer: feels gravity but is left out of the tree, so it sources
+    // none and costs nothing to build; mass stays its inertia for tools
+    kParticleTracer = 1u << 0,
+    // Heavy body (central mass, black hole): left out of the tree and summed
+    // directly against every particle, so node moments only see the smooth component
+    kParticleHeavy = 1u << 1,
+    // Heavy body in a regularized close pair (set by the engine each step):
+    // integrated with its partner instead of by the global step
+    kParticleRegularized = 1u << 2,
+};
+
+template <typename T, int D> inline bool isTracer(const BasicParticle<T, D>& p) { return (p.flags & kParticleTracer) != 0; }
+template <typename T, int D> inline bool isHeavy(const BasicParticle<T, D>& p) { return (p.flags & kParticleHeavy) != 0; }
+template <typename T, int D> inline bool inTree(const BasicParticle<T, D>& p) { return (p.flags & (kParticleTracer | kParticleHeavy)) == 0; }
+
+// Absorbed particles stay in place, massless and frozen, until the engine
+// compacts them away in a batch; a negative radius marks them
+template <typename T, int D> inline bool isDead(const BasicParticle<T, D>& p) { return p.radius < T(0); }
+template <typename T, int D> inline void markDead(BasicParticle<T, D>& p) {
+    p.mass = T(0);
+    p.radius = T(-1);
+    p.charge = T(0);
+    p.velocity = glm::vec<D, T>(T(0));
+}
+
+// Particle storage: pages are first-touched in parallel (NUMA-local slices)
+template <typename T, int D>
+using BasicParticleArray = std::vector<BasicParticle<T, D>, FirstTouchAllocator<BasicParticle<T, D>>>;
+using ParticleArray = BasicParticleArray<float, 3>;
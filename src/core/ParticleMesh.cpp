@@ -0,0 +1,132 @@
+#include "ParticleMesh.h"
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+// Wave number of grid index i along one axis
+static float waveNumber(int i, int n, float boxSize) {
+    return 2.0f * glm::pi<float>() / boxSize * (float)((i <= n / 2) ? i : i - n);
+}
+
+void ParticleMesh::setParams(const PMParams& p) {
+    if (ready && p.grid == params.grid && p.boxSize == params.boxSize && p.G == params.G && p.splitScale == params.splitScale) return;
+    params = p;
+    ready = true;
+    const int n = params.grid;
+    const size_t cells = (size_t)n * n * n;
+    fft.resize(n);
+    density.resize(cells);
+    potential.resize(cells);
+    work.resize(cells);
+    for (auto& f : force) f.resize(cells);
+
+    // phi_k = -4 pi G rho_k / k^2 * exp(-k^2 r_s^2) / W(k)^2, W = CIC window
+    // applied once by the deposit and once by the interpolation
+    green.resize(cells);
+    const float cell = params.boxSize / n;
+    const float rs2 = params.splitScale * params.splitScale;
+    auto window = [&](float k) {
+        float x = 0.5f * k * cell;
+        float s = (x != 0.0f) ? sinf(x) / x : 1.0f;
+        return s * s;
+    };
+    #pragma omp parallel for schedule(static)
+    for (int z = 0; z < n; ++z) {
+        for (int y = 0; y < n; ++y) {
+            for (int x = 0; x < n; ++x) {
+                float kx = waveNumber(x, n, params.boxSize), ky = waveNumber(y, n, params.boxSize), kz = waveNumber(z, n, params.boxSize);
+                float k2 = kx * kx + ky * ky + kz * kz;
+                float w = window(kx) * window(ky) * window(kz);
+                size_t idx = ((size_t)z * n + y) * n + x;
+                green[idx] = (k2 > 0.0f) ? -4.0f * glm::pi<float>() * params.G * expf(-k2 * rs2) / (k2 * w * w) : 0.0f;
+            }
+        }
+    }
+}
+
+namespace {
+// Cloud-in-cell stencil of a position: base cell and weights along each axis
+struct CicStencil {
+    int i[3];
+    float w[3][2];
+};
+
+CicStencil cicStencil(const glm::vec3& pos, float boxSize, int n) {
+    CicStencil c;
+    glm::vec3 u = (pos / boxSize + 0.5f) * (float)n - 0.5f; // cell centres at integers
+    for (int d = 0; d < 3; ++d) {
+        float f = floorf(u[d]);
+        c.i[d] = (int)f;
+        c.w[d][1] = u[d] - f;
+        c.w[d][0] = 1.0f - c.w[d][1];
+    }
+    return c;
+}
+} // namespace
+
+void ParticleMesh::computeAccelerations(const ParticleArray& particles, std::vector<glm::vec3>& accel) {
+    const int n = params.grid;
+    const int mask = n - 1; // periodic wrap, also for negative indices
+    const long cells = (long)n * n * n;
+    const int count = (int)particles.size();
+    accel.resize(count);
+
+    #pragma omp parallel for schedule(static)
+    for (long c = 0; c < cells; ++c) density[c] = 0.0f;
+    #pragma omp parallel for schedule(static)
+    for (int p = 0; p < count; ++p) {
+        const Particle& pt = particles[p];
+        if (!inTree(pt) || pt.mass <= 0.0f) continue;
+        CicStencil s = cicStencil(pt.position, params.boxSize, n);
+        for (int dz = 0; dz < 2; ++dz)
+            for (int dy = 0; dy < 2; ++dy)
+                for (int dx = 0; dx < 2; ++dx) {
+                    long idx = ((long)((s.i[2] + dz) & mask) * n + ((s.i[1] + dy) & mask)) * n + ((s.i[0] + dx) & mask);
+                    float m = pt.mass * s.w[0][dx] * s.w[1][dy] * s.w[2][dz];
+                    #pragma omp atomic
+                    density[idx] += m;
+                }
+    }
+
+    const float invCellVolume = powf((float)n / params.boxSize, 3.0f);
+    #pragma omp parallel for schedule(static)
+    for (long c = 0; c < cells; ++c) potential[c] = FFT3D::Complex(density[c] * invCellVolume, 0.0f);
+    fft.forward(potential.data());
+    #pragma omp parallel for schedule(static)
+    for (long c = 0; c < cells; ++c) potential[c] *= green[c];
+
+    // a = -grad phi: multiply by -i k per axis and transform back
+    for (int d = 0; d < 3; ++d) {
+        #pragma omp parallel for schedule(static)
+        for (int z = 0; z < n; ++z) {
+            for (int y = 0; y < n; ++y) {
+                for (int x = 0; x < n; ++x) {
+                    const int i = (d == 0) ? x : (d == 1) ? y : z;
+                    const float k = (i == n / 2) ? 0.0f : waveNumber(i, n, params.boxSize); // odd derivative: drop Nyquist
+                    const long idx = ((long)z * n + y) * n + x;
+                    const FFT3D::Complex ph = potential[idx];
+                    work[idx] = FFT3D::Complex(k * ph.imag(), -k * ph.real());
+                }
+            }
+        }
+        fft.inverse(work.data());
+        #pragma omp parallel for schedule(static)
+        for (long c = 0; c < cells; ++c) force[d][c] = work[c].real();
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int p = 0; p < count; ++p) {
+        const Particle& pt = particles[p];
+        glm::vec3 a(0.0f);
+        if (!isDead(pt)) {
+            CicStencil s = cicStencil(pt.position, params.boxSize, n);
+            for (int dz = 0; dz < 2; ++dz)
+                for (int dy = 0; dy < 2; ++dy)
+                    for (int dx = 0; dx < 2; ++dx) {
+                        long idx = ((long)((s.i[2] + dz) & mask) * n + ((s.i[1] + dy) & mask)) * n + ((s.i[0] + dx) & mask);
+                        float w = s.w[0][dx] * s.w[1][dy] * s.w[2][dz];
+                        a += w * glm::vec3(force[0][idx], force[1][idx], force[2][idx]);
+                    }
+        }
+        accel[p] = a;
+    }
+}
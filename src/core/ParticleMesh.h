@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "FFT.h"
+#include "Particle.h"
+
+struct PMParams {
+    int grid = 64;           // cells per side, a power of two
+    float boxSize = 1000.0f; // periodic cube [-L/2, L/2)
+    float G = 1.0f;
+    // Split scale r_s: mesh forces are filtered by exp(-k^2 r_s^2) and the tree
+    // supplies the erfc-truncated remainder; 0 = full mesh force (PM only)
+    float splitScale = 0.0f;
+};
+
+// Long-range gravity on a periodic mesh: CIC deposit of the tree particles
+// (see inTree), FFT Poisson solve with the CIC window deconvolved, spectral
+// gradient, CIC interpolation back to every particle
+class ParticleMesh {
+public:
+    void setParams(const PMParams& p);
+    const PMParams& getParams() const { return params; }
+    // accel is resized to the particle count
+    void computeAccelerations(const ParticleArray& particles, std::vector<glm::vec3>& accel);
+
+private:
+    PMParams params;
+    bool ready = false;
+    FFT3D fft;
+    std::vector<float> density;                 // mass per cell
+    std::vector<float> green;                   // Green's function per mode
+    std::vector<FFT3D::Complex> potential, work;
+    std::vector<float> force[3];                // mesh acceleration per axis
+};
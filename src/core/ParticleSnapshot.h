@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "BarnesHut.h"
+#include "SimulationEngine.h"
+#include "FrameProfile.h"
+#include "PageAllocator.h"
+
+// Per-particle data the renderer needs; laid out exactly like the particle
+// vertex buffer so a snapshot uploads with a single copy
+struct RenderParticle {
+    glm::vec3 position;
+    float radius;
+    glm::vec4 color;
+    glm::vec3 velocity;
+    ParticleId id; // stable across steps; kInvalidParticleId for dead slots
+    glm::vec3 prevPosition; // position one step earlier, for render interpolation
+    float pad1;
+};
+
+// Immutable view of one simulation step, published by SimulationThread.
+// Buffers are recycled by the triple buffer, so vectors keep their capacity.
+struct ParticleSnapshot {
+    std::vector<RenderParticle> particles; // dead particles are included, fully transparent
+    size_t liveParticles = 0;
+    uint64_t step = 0;
+    double stepsPerSecond = 0.0;
+    // Simulation-to-world rotation; positions and velocities are in the simulation frame
+    glm::quat worldFrame{1.0f, 0.0f, 0.0f, 0.0f};
+    PickInfo picked;
+    // Fixed-rate pacing: the renderer blends prevPosition -> position over
+    // stepInterval seconds starting at publishTime (steady clock). 0 = no blending.
+    double publishTime = 0.0;
+    double stepInterval = 0.0;
+    FrameProfile profile;
+    TreeStats treeStats;
+    PagePlacementReport pagePlacement;
+    SolverProfile solver;
+    bool solverLoaded = false; // from SolverProfile::kDefaultPath, else defaults
+    int forceChunk = 0;        // 0: static schedule
+    bool perfAvailable = false;
+    std::string perfStatus;
+};
@@ -0,0 +1,112 @@
+#include "ParticleStore.h"
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+void ParticleStore::adopt() {
+    if (particles.size() > kMaxIds) throw std::length_error("ParticleStore: more particles than 24-bit IDs");
+    const uint32_t n = (uint32_t)particles.size();
+    slotIds.resize(n);
+    idSlots.resize(n);
+    generations.assign(n, 0);
+    freeSlots.clear();
+    freeIds.clear();
+    for (uint32_t i = 0; i < n; ++i) { slotIds[i] = i; idSlots[i] = i; }
+    ++version;
+}
+
+void ParticleStore::clear() {
+    particles.clear();
+    particles.shrink_to_fit();
+    scratch.clear();
+    scratch.shrink_to_fit();
+    slotIds.clear(); idSlots.clear(); generations.clear();
+    freeSlots.clear(); freeIds.clear();
+    ++version;
+}
+
+ParticleId ParticleStore::allocateId(uint32_t slot) {
+    uint32_t idx;
+    if (!freeIds.empty()) {
+        idx = freeIds.back();
+        freeIds.pop_back();
+    } else {
+        idx = (uint32_t)idSlots.size();
+        idSlots.push_back(kNoSlot);
+        generations.push_back(0);
+    }
+    idSlots[idx] = slot;
+    return ((ParticleId)generations[idx] << kIndexBits) | idx;
+}
+
+ParticleId ParticleStore::spawn(const Particle& p) {
+    if (freeIds.empty() && idSlots.size() >= kMaxIds) return kInvalidParticleId;
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+        particles[slot] = p;
+    } else {
+        slot = (uint32_t)particles.size();
+        particles.push_back(p);
+        slotIds.push_back(kInvalidParticleId);
+    }
+    ParticleId id = allocateId(slot);
+    slotIds[slot] = id;
+    ++version;
+    return id;
+}
+
+void ParticleStore::kill(int slot) {
+    Particle& p = particles[slot];
+    if (isDead(p)) return;
+    markDead(p);
+    uint32_t idx = slotIds[slot] & kIndexMask;
+    idSlots[idx] = kNoSlot;
+    ++generations[idx]; // stale handles stop resolving; wraps after 256 reuses
+    freeIds.push_back(idx);
+    slotIds[slot] = kInvalidParticleId;
+    freeSlots.push_back((uint32_t)slot);
+}
+
+// Parallel stable compaction: per-thread counts, a prefix sum, then each
+// thread copies its live particles into the scratch arrays at its offset
+void ParticleStore::compact() {
+    if (freeSlots.empty()) return;
+    const int n = (int)particles.size();
+    scratch.resize(liveCount());
+    scratchIds.resize(liveCount());
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    offsets.assign(nthreads + 1, 0);
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int t = 0, nt = 1;
+#ifdef _OPENMP
+        t = omp_get_thread_num();
+        nt = omp_get_num_threads();
+#endif
+        const int begin = (int)((int64_t)n * t / nt), end = (int)((int64_t)n * (t + 1) / nt);
+        int live = 0;
+        for (int i = begin; i < end; ++i) live += !isDead(particles[i]);
+        offsets[t + 1] = live;
+        #pragma omp barrier
+        #pragma omp single
+        for (int k = 0; k < nt; ++k) offsets[k + 1] += offsets[k];
+        int out = offsets[t];
+        for (int i = begin; i < end; ++i) {
+            if (isDead(particles[i])) continue;
+            scratch[out] = particles[i];
+            scratchIds[out] = slotIds[i];
+            idSlots[slotIds[i] & kIndexMask] = (uint32_t)out;
+            ++out;
+        }
+    }
+    particles.swap(scratch);
+    slotIds.swap(scratchIds);
+    freeSlots.clear();
+    ++version;
+}
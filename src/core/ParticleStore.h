@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Particle.h"
+
+// Stable particle handle: 24-bit index into the ID table plus an 8-bit
+// generation, so a freed ID that gets reused no longer resolves
+using ParticleId = uint32_t;
+constexpr ParticleId kInvalidParticleId = 0xFFFFFFFFu;
+
+// Particle pool. Slots are positions in data(); IDs stay valid while the
+// particle lives, across kills, spawns and compactions. Killing leaves a
+// tombstone (see isDead) whose slot goes to a free list and is reused by the
+// next spawn, so neither operation moves other particles or reallocates.
+// compact() drops the tombstones in one parallel pass.
+class ParticleStore {
+public:
+    static constexpr uint32_t kIndexBits = 24;
+    static constexpr uint32_t kIndexMask = (1u << kIndexBits) - 1u;
+    // Index kIndexMask is never handed out, so no ID can equal kInvalidParticleId
+    static constexpr uint32_t kMaxIds = kIndexMask;
+
+    ParticleArray& data() { return particles; }
+    const ParticleArray& data() const { return particles; }
+    size_t size() const { return particles.size(); } // slots, tombstones included
+    size_t liveCount() const { return particles.size() - freeSlots.size(); }
+    size_t deadCount() const { return freeSlots.size(); }
+
+    // Gives every particle currently in data() a fresh ID (after bulk init);
+    // throws std::length_error past kMaxIds particles
+    void adopt();
+    void clear();
+    // Spawns into a tombstone if there is one, else appends. Returns
+    // kInvalidParticleId, spawning nothing, once all kMaxIds IDs are in use
+    ParticleId spawn(const Particle& p);
+    void kill(int slot);
+
+    ParticleId idOf(int slot) const { return slotIds[slot]; }
+    int slotOf(ParticleId id) const {
+        uint32_t idx = id & kIndexMask;
+        if (id == kInvalidParticleId || idx >= idSlots.size() || generations[idx] != (id >> kIndexBits)) return -1;
+        return (int)idSlots[idx];
+    }
+    const std::vector<ParticleId>& ids() const { return slotIds; } // kInvalidParticleId for tombstones
+    size_t idCapacity() const { return idSlots.size(); } // bound on the index part of any ID
+
+    // Removes tombstones, keeping the order of live particles
+    void compact();
+    // Bumped whenever a slot changes owner (spawn into a slot, append, compaction)
+    uint64_t layoutVersion() const { return version; }
+
+private:
+    static constexpr uint32_t kNoSlot = 0xFFFFFFFFu;
+    ParticleArray particles;
+    std::vector<ParticleId> slotIds;   // slot -> id
+    std::vector<uint32_t> idSlots;     // id index -> slot (kNoSlot when free)
+    std::vector<uint8_t> generations;  // id index -> current generation
+    std::vector<uint32_t> freeSlots;   // tombstones
+    std::vector<uint32_t> freeIds;     // released id indices
+    ParticleArray scratch;
+    std::vector<ParticleId> scratchIds;
+    std::vector<int> offsets;
+    uint64_t version = 0;
+
+    ParticleId allocateId(uint32_t slot);
+};
@@ -0,0 +1,134 @@
+#include "PerfCounters.h"
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+PerfCounters::~PerfCounters() { close(); }
+
+#if defined(__linux__) && defined(SYS_perf_event_open)
+
+namespace {
+const uint64_t kEventConfig[4] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, // last-level cache misses on common PMUs
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+int openEvent(uint64_t config, int groupFd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (groupFd == -1) ? 1 : 0;
+    attr.exclude_kernel = 1; // allowed up to perf_event_paranoid = 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0 /*this thread*/, -1, groupFd, 0);
+}
+} // namespace
+
+bool PerfCounters::open(bool wantPerThread) {
+    close();
+    perThread = wantPerThread;
+    int threads = 1;
+#ifdef _OPENMP
+    if (perThread) threads = omp_get_max_threads();
+#endif
+    std::vector<Group> opened(threads);
+    int firstErrno = 0;
+
+    auto openGroup = [&](Group& g) {
+        g.fd[0] = openEvent(kEventConfig[0], -1);
+        if (g.fd[0] < 0) return errno;
+        // members that the PMU lacks are simply left closed
+        for (int e = 1; e < kEvents; ++e) g.fd[e] = openEvent(kEventConfig[e], g.fd[0]);
+        return 0;
+    };
+
+    if (perThread) {
+        // counters are bound to the thread that opens them: open one group per worker
+        #pragma omp parallel num_threads(threads)
+        {
+            int t = 0;
+#ifdef _OPENMP
+            t = omp_get_thread_num();
+#endif
+            int err = openGroup(opened[t]);
+            if (err) {
+                #pragma omp critical
+                if (!firstErrno) firstErrno = err;
+            }
+        }
+    } else {
+        firstErrno = openGroup(opened[0]);
+    }
+
+    groups = std::move(opened);
+    if (firstErrno) {
+        close();
+        statusText = std::string("perf_event_open: ") + std::strerror(firstErrno);
+        if (firstErrno == EACCES || firstErrno == EPERM) statusText += " (check /proc/sys/kernel/perf_event_paranoid)";
+        return false;
+    }
+    statusText = perThread ? "per-thread" : "calling thread";
+    return true;
+}
+
+void PerfCounters::close() {
+    for (auto& g : groups) {
+        for (int& fd : g.fd) { if (fd >= 0) ::close(fd); fd = -1; }
+    }
+    groups.clear();
+    statusText = "closed";
+}
+
+void PerfCounters::start() {
+    for (auto& g : groups) {
+        ioctl(g.fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(g.fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+PerfSample PerfCounters::stop() {
+    PerfSample total;
+    for (auto& g : groups) {
+        ioctl(g.fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        // PERF_FORMAT_GROUP: { nr, values[nr] } in the order members were opened
+        uint64_t buf[1 + kEvents] = {};
+        if (read(g.fd[0], buf, sizeof(buf)) <= 0) continue;
+        uint64_t values[kEvents] = {};
+        uint64_t next = 1;
+        for (int e = 0; e < kEvents && next <= buf[0]; ++e) {
+            if (g.fd[e] >= 0) values[e] = buf[next++];
+        }
+        total.cycles += values[0];
+        total.instructions += values[1];
+        total.llcMisses += values[2];
+        total.branchMisses += values[3];
+    }
+    return total;
+}
+
+#else
+
+bool PerfCounters::open(bool wantPerThread) {
+    perThread = wantPerThread;
+    statusText = "hardware counters not supported on this platform";
+    return false;
+}
+void PerfCounters::close() { groups.clear(); statusText = "closed"; }
+void PerfCounters::start() {}
+PerfSample PerfCounters::stop() { return {}; }
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Raw hardware counts for one measured interval (summed over measured threads)
+struct PerfSample {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t llcMisses = 0;
+    uint64_t branchMisses = 0;
+
+    double ipc() const { return cycles ? (double)instructions / (double)cycles : 0.0; }
+    PerfSample& operator+=(const PerfSample& o) {
+        cycles += o.cycles; instructions += o.instructions;
+        llcMisses += o.llcMisses; branchMisses += o.branchMisses;
+        return *this;
+    }
+};
+
+// Hardware performance counters via perf_event_open (Linux only).
+// One counter group (cycles, instructions, LLC misses, branch misses) is
+// opened for the calling thread, or for every OpenMP worker when perThread
+// is set. When counters are unsupported or not permitted (perf_event_paranoid,
+// containers, other OSes) open() returns false, status() says why and
+// start()/stop() become no-ops returning zeros.
+class PerfCounters {
+public:
+    PerfCounters() = default;
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool open(bool perThread);
+    void close();
+    bool available() const { return !groups.empty(); }
+    bool isPerThread() const { return perThread; }
+    const std::string& status() const { return statusText; }
+
+    void start();
+    PerfSample stop();
+
+private:
+    static constexpr int kEvents = 4;
+    struct Group { int fd[kEvents]{-1, -1, -1, -1}; };
+    std::vector<Group> groups;
+    bool perThread = false;
+    std::string statusText = "closed";
+};
@@ -0,0 +1,151 @@
+#include "QualityGovernor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <iterator>
+
+static const float kThetaStep = 0.05f;
+static const float kRenderScaleStep = 0.125f;
+
+const char* qualityKnobName(QualityKnob k) {
+    switch (k) {
+        case QualityKnob::TreeRefit: return "arbol";
+        case QualityKnob::Collisions: return "colisiones";
+        case QualityKnob::Bloom: return "bloom";
+        case QualityKnob::Theta: return "theta";
+        case QualityKnob::RenderScale: return "resolucion";
+        default: return "?";
+    }
+}
+
+// 0 = simulation budget, 1 = render budget
+static int knobSide(QualityKnob k) {
+    return (k == QualityKnob::Bloom || k == QualityKnob::RenderScale) ? 1 : 0;
+}
+
+static int log2Floor(int v) {
+    int l = 0;
+    while (v > 1) { v >>= 1; ++l; }
+    return l;
+}
+
+int QualityGovernor::maxLevel(QualityKnob k) const {
+    switch (k) {
+        case QualityKnob::TreeRefit: return log2Floor(std::max(1, cfg.rebuildEveryMax));
+        case QualityKnob::Collisions: return base.collisions ? log2Floor(std::max(1, cfg.collisionEveryMax)) : 0;
+        case QualityKnob::Bloom: return std::max(0, baseBlurPasses - cfg.blurPassesMin);
+        case QualityKnob::Theta: return std::max(0, (int)std::ceil((cfg.thetaMax - base.theta) / kThetaStep - 1e-3f));
+        case QualityKnob::RenderScale: return std::max(0, (int)((1.0f - cfg.renderScaleMin) / kRenderScaleStep + 1e-3f));
+        default: return 0;
+    }
+}
+
+void QualityGovernor::apply(SimulationSettings& s) const {
+    if (int l = levels[(int)QualityKnob::TreeRefit]) {
+        s.rebuildEveryN = std::max(s.rebuildEveryN, 1 << l);
+        s.refitBetweenBuilds = true;
+    }
+    if (int l = levels[(int)QualityKnob::Collisions]) s.collisionEveryN = std::max(s.collisionEveryN, 1 << l);
+    if (int l = levels[(int)QualityKnob::Theta]) s.theta = std::min(s.theta + l * kThetaStep, std::max(s.theta, cfg.thetaMax));
+}
+
+int QualityGovernor::blurPassLimit() const {
+    return baseBlurPasses - levels[(int)QualityKnob::Bloom];
+}
+
+float QualityGovernor::renderScale() const {
+    return std::max(cfg.renderScaleMin, 1.0f - levels[(int)QualityKnob::RenderScale] * kRenderScaleStep);
+}
+
+void QualityGovernor::describe(QualityKnob k, char* out, size_t n) const {
+    SimulationSettings s = base;
+    apply(s);
+    switch (k) {
+        case QualityKnob::TreeRefit: snprintf(out, n, "rebuild cada %d", s.rebuildEveryN); break;
+        case QualityKnob::Collisions: snprintf(out, n, "colisiones cada %d", s.collisionEveryN); break;
+        case QualityKnob::Bloom: snprintf(out, n, "bloom %d pasadas", blurPassLimit()); break;
+        case QualityKnob::Theta: snprintf(out, n, "theta %.2f", s.theta); break;
+        case QualityKnob::RenderScale: snprintf(out, n, "resolucion %.0f%%", renderScale() * 100.0f); break;
+        default: out[0] = '\0'; break;
+    }
+}
+
+void QualityGovernor::addLog(const char* fmt, ...) {
+    LogEntry& e = log[logHead];
+    e.frame = frame;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(e.text, sizeof(e.text), fmt, args);
+    va_end(args);
+    logHead = (logHead + 1) % kLogSize;
+    logSize = std::min(logSize + 1, kLogSize);
+}
+
+// Moves one knob of a side by one level: dir > 0 degrades in priority order,
+// dir < 0 restores in reverse. Returns false when nothing is left to move.
+bool QualityGovernor::step(int side, int dir, double ms, double budget) {
+    const int n = (int)QualityKnob::Count;
+    for (int i = 0; i < n; ++i) {
+        QualityKnob k = cfg.priority[dir > 0 ? i : n - 1 - i];
+        if (knobSide(k) != side) continue;
+        int& l = levels[(int)k];
+        if (dir > 0 ? l >= maxLevel(k) : l <= 0) continue;
+        l += dir;
+        char what[48];
+        describe(k, what, sizeof(what));
+        addLog("%s %.1f/%.1f ms: %s %s -> %s", side ? "render" : "sim", ms, budget,
+               dir > 0 ? "baja" : "sube", qualityKnobName(k), what);
+        return true;
+    }
+    return false;
+}
+
+void QualityGovernor::update(const GovernorSettings& g, const SimulationSettings& user, int userBlurPasses, double frameMs, const ParticleSnapshot& snapshot) {
+    ++frame;
+    cfg = g;
+    base = user;
+    baseBlurPasses = userBlurPasses;
+    if (!g.enabled) {
+        if (std::any_of(std::begin(levels), std::end(levels), [](int l) { return l != 0; })) {
+            std::fill(std::begin(levels), std::end(levels), 0);
+            addLog("desactivado: calidad restaurada");
+        }
+        overFrames[0] = overFrames[1] = underFrames[0] = underFrames[1] = 0;
+        return;
+    }
+    // user changes can shrink the range of a knob
+    for (int k = 0; k < (int)QualityKnob::Count; ++k) levels[k] = std::min(levels[k], maxLevel((QualityKnob)k));
+
+    // exponential moving averages; the step cost only changes when a new snapshot lands
+    const double kSmooth = 0.1;
+    if (snapshot.step != lastStep) {
+        lastStep = snapshot.step;
+        double stepMs = snapshot.profile.totalMs();
+        smoothedMs[0] = smoothedMs[0] > 0.0 ? smoothedMs[0] + kSmooth * (stepMs - smoothedMs[0]) : stepMs;
+    }
+    smoothedMs[1] = smoothedMs[1] > 0.0 ? smoothedMs[1] + kSmooth * (frameMs - smoothedMs[1]) : frameMs;
+    const double budget[2] = { user.simRate > 0.0f ? 1000.0 / user.simRate : g.targetFrameMs, g.targetFrameMs };
+    for (int side = 0; side < 2; ++side) load[side] = smoothedMs[side] / std::max(1e-3, budget[side]);
+
+    if (cooldown > 0) { --cooldown; return; }
+    for (int side = 0; side < 2; ++side) {
+        overFrames[side] = load[side] > g.degradeAbove ? overFrames[side] + 1 : 0;
+        underFrames[side] = load[side] < g.restoreBelow ? underFrames[side] + 1 : 0;
+
+        int dir = 0;
+        if (overFrames[side] >= g.degradeFrames) dir = 1;
+        else if (underFrames[side] >= g.restoreFrames) dir = -1;
+        if (dir == 0) continue;
+        overFrames[side] = underFrames[side] = 0;
+        if (step(side, dir, smoothedMs[side], budget[side])) {
+            exhausted[side] = false;
+            cooldown = g.cooldownFrames;
+            return; // one change per settle period
+        }
+        if (dir > 0 && !exhausted[side]) {
+            exhausted[side] = true;
+            addLog("%s %.1f/%.1f ms: sin margen", side ? "render" : "sim", smoothedMs[side], budget[side]);
+        }
+    }
+}
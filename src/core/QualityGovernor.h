@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include "SimulationEngine.h"
+#include "ParticleSnapshot.h"
+
+// Knobs the governor may turn, each bound to the budget it relieves
+enum class QualityKnob {
+    TreeRefit,   // rebuild the tree less often, refit in between (simulation)
+    Collisions,  // resolve collisions every N steps (simulation)
+    Bloom,       // fewer bloom blur passes (render)
+    Theta,       // wider opening angle (simulation)
+    RenderScale, // lower scene resolution (render)
+    Count
+};
+
+const char* qualityKnobName(QualityKnob k);
+
+struct GovernorSettings {
+    bool enabled = false;
+    float targetFrameMs = 16.7f; // render loop budget
+    // Simulation budget is one step per 1/simRate; free-running simulations use targetFrameMs
+    float degradeAbove = 1.0f; // load (measured / budget) that costs quality
+    float restoreBelow = 0.7f; // load under which quality is given back
+    int degradeFrames = 15;    // consecutive frames over budget before acting
+    int restoreFrames = 120;   // consecutive frames under budget before acting
+    int cooldownFrames = 30;   // frames ignored after a change while timings settle
+    // Bounds
+    float thetaMax = 1.0f;
+    int rebuildEveryMax = 8;
+    int collisionEveryMax = 4;
+    int blurPassesMin = 0;
+    float renderScaleMin = 0.5f;
+    // Degraded first to last, restored in reverse
+    QualityKnob priority[(int)QualityKnob::Count] = {
+        QualityKnob::TreeRefit, QualityKnob::Collisions, QualityKnob::Bloom, QualityKnob::Theta, QualityKnob::RenderScale
+    };
+};
+
+// Reads per-phase timings every frame and steps knobs one level at a time to
+// hold the frame and step budgets. The user's settings are the baseline: the
+// governor only derives effective values on top of them, so sliders keep
+// working and disabling the governor restores them exactly.
+class QualityGovernor {
+public:
+    struct LogEntry {
+        uint64_t frame = 0;
+        char text[96] = {};
+    };
+    static constexpr int kLogSize = 32;
+
+    // frameMs: duration of the last main-loop frame
+    void update(const GovernorSettings& g, const SimulationSettings& user, int userBlurPasses, double frameMs, const ParticleSnapshot& snapshot);
+    // Effective values for the current levels
+    void apply(SimulationSettings& s) const;
+    int blurPassLimit() const;
+    float renderScale() const;
+
+    int level(QualityKnob k) const { return levels[(int)k]; }
+    double simLoad() const { return load[0]; }
+    double renderLoad() const { return load[1]; }
+    // i = 0 is the newest entry
+    int logCount() const { return logSize; }
+    const LogEntry& logEntry(int i) const { return log[(logHead - 1 - i + kLogSize) % kLogSize]; }
+
+private:
+    GovernorSettings cfg;
+    SimulationSettings base;
+    int baseBlurPasses = 0;
+    int levels[(int)QualityKnob::Count] = {};
+    // per side: 0 = simulation, 1 = render
+    double smoothedMs[2] = {};
+    double load[2] = {};
+    int overFrames[2] = {};
+    int underFrames[2] = {};
+    bool exhausted[2] = {};
+    int cooldown = 0;
+    uint64_t frame = 0;
+    uint64_t lastStep = 0;
+    LogEntry log[kLogSize];
+    int logHead = 0, logSize = 0;
+
+    int maxLevel(QualityKnob k) const;
+    bool step(int side, int dir, double ms, double budget);
+    void describe(QualityKnob k, char* out, size_t n) const;
+    void addLog(const char* fmt, ...);
+};
@@ -0,0 +1,42 @@
+#include "Regularization.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+int advanceRegularizedPair(glm::vec3& r, glm::vec3& v, float mu, const glm::vec3& perturb, float dt,
+                           int stepsPerOrbit, int maxSteps) {
+    // sub-steps accumulate: double precision inside
+    glm::dvec3 R(r), V(v);
+    const glm::dvec3 F(perturb);
+    const double m = mu;
+    auto accel = [&](const glm::dvec3& x) {
+        double d = glm::length(x);
+        return -m / (d * d * d) * x + F;
+    };
+    double B = m / glm::length(R) - 0.5 * glm::dot(V, V);
+    // s-length of one orbit: U integrates to mu P / a = 2 pi sqrt(mu a), and
+    // a = mu / 2B gives 2 pi mu / sqrt(2B); unbound pairs fall back to the
+    // current separation (B = mu / 4r, an orbit of a = 2r)
+    const double h = 2.0 * glm::pi<double>() * m / std::sqrt(2.0 * std::max(B, 0.25 * m / glm::length(R))) / std::max(1, stepsPerOrbit);
+    double t = 0.0;
+    int steps = 0;
+    auto drift = [&](double ds) {
+        double tau = ds / (0.5 * glm::dot(V, V) + B);
+        R += tau * V;
+        t += tau;
+    };
+    // a step lasts about ds / U; the last ones are shortened to land on dt
+    while (t < dt * (1.0 - 1e-6) && steps < maxSteps) {
+        const double ds = std::min(h, (dt - t) * m / glm::length(R));
+        drift(0.5 * ds);
+        double tau = ds / (m / glm::length(R));
+        glm::dvec3 v0 = V;
+        V += tau * accel(R);
+        B -= tau * 0.5 * glm::dot(v0 + V, F);
+        drift(0.5 * ds);
+        ++steps;
+    }
+    r = glm::vec3(R);
+    v = glm::vec3(V);
+    return steps;
+}
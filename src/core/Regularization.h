@@ -0,0 +1,13 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// Advances the relative orbit of a bound pair by dt with the logarithmic
+// Hamiltonian (time-transformed) leapfrog: drift dt = h / (T + B), kick
+// dt = h / U, where B is the binding energy evolved under perturb. Steps
+// shrink in time near pericentre, so the Kepler orbit is followed exactly
+// up to a phase error however eccentric it is. r, v: relative position and
+// velocity (second minus first body); mu = G (m1 + m2); perturb: difference
+// of the external accelerations, held constant over dt. The final steps are
+// shortened to end on dt (to ~1e-6 of it). Returns the sub-steps taken.
+int advanceRegularizedPair(glm::vec3& r, glm::vec3& v, float mu, const glm::vec3& perturb, float dt,
+                           int stepsPerOrbit, int maxSteps);
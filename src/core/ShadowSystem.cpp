@@ -0,0 +1,132 @@
+#include "ShadowSystem.h"
+#include <algorithm>
+#include <cmath>
+
+template <typename T, int D>
+typename ShadowSystem<T, D>::Vec ShadowSystem<T, D>::fromView(const glm::vec3& v) {
+    if constexpr (D == 2) return Vec(v.x, v.z);
+    else return Vec(v);
+}
+
+template <typename T, int D>
+glm::vec3 ShadowSystem<T, D>::toView(const Vec& v) {
+    if constexpr (D == 2) return glm::vec3((float)v.x, 0.0f, (float)v.y);
+    else return glm::vec3(v);
+}
+
+template <typename T, int D>
+void ShadowSystem<T, D>::sync(const ParticleArray& view) {
+    const int n = (int)view.size();
+    const int kept = std::min(n, (int)particles.size());
+    particles.resize(n);
+    lastAccel.resize(n);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; ++i) {
+        const Particle& v = view[i];
+        BasicParticle<T, D>& p = particles[i];
+        p.mass = v.mass;
+        p.radius = v.radius;
+        p.charge = v.charge;
+        p.flags = v.flags;
+        // untouched slots keep the precision the view cannot hold
+        if (i >= kept || toView(p.position) != v.position) {
+            p.position = fromView(v.position);
+            lastAccel[i] = T(0);
+        }
+        if (i >= kept || toView(p.velocity) != v.velocity) p.velocity = fromView(v.velocity);
+    }
+    heavy.clear();
+    for (int i = 0; i < n; ++i) if (isHeavy(particles[i]) && !isDead(particles[i])) heavy.push_back(i);
+}
+
+template <typename T, int D>
+void ShadowSystem<T, D>::updateTree(const BarnesHutParams& p, bool rebuild, bool refit) {
+    params = p;
+    tree.setParams(p);
+    if (rebuild || tree.builtCount() != (int)particles.size()) tree.build(particles);
+    else if (refit) tree.refit(particles);
+}
+
+template <typename T, int D>
+template <typename Stats>
+typename ShadowSystem<T, D>::Vec ShadowSystem<T, D>::accelOf(int i, const BackgroundPotential& background, Stats& stats) const {
+    const BasicParticle<T, D>& p = particles[i];
+    const T G = params.G;
+    const T eps2 = T(params.softening) * T(params.softening);
+    Vec a = tree.computeForce(i, particles, stats, lastAccel[i]);
+    for (int h : heavy) {
+        if (h == i) continue;
+        Vec r = particles[h].position - p.position;
+        T d2 = glm::dot(r, r) + eps2;
+        a += (G * particles[h].mass / (d2 * std::sqrt(d2))) * r;
+    }
+    if (background.type != BackgroundPotentialType::None) {
+        a += backgroundPull(background, G, T(params.softening), fromView(background.center) - p.position);
+    }
+    return a;
+}
+
+template <typename T, int D>
+glm::vec3 ShadowSystem<T, D>::acceleration(int i, const BackgroundPotential& background) const {
+    NoTraversalStats none;
+    return toView(accelOf(i, background, none));
+}
+
+// Two loops where the float path fuses them: this tree reads the particles
+// themselves, so none may move before every walk is done
+template <typename T, int D>
+void ShadowSystem<T, D>::step(ParticleArray& view, const BackgroundPotential& background, float dt, float damping, int chunk,
+                              TraversalCounters* counters) {
+    const int n = (int)particles.size();
+    accel.resize(n);
+    // absorbed since sync: skipped, the slot is compacted or respawned later
+    auto live = [&](int i) { return !isDead(view[i]) && particles[i].mass > T(0); };
+    if (!counters) {
+        auto accelAt = [&](int i) {
+            NoTraversalStats none;
+            accel[i] = live(i) ? accelOf(i, background, none) : Vec(T(0));
+        };
+        if (chunk > 0) {
+            #pragma omp parallel for schedule(dynamic, chunk)
+            for (int i = 0; i < n; ++i) accelAt(i);
+        } else {
+            #pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; ++i) accelAt(i);
+        }
+    } else {
+        TraversalCounters total;
+        #pragma omp parallel
+        {
+            TraversalCounters local;
+            if (chunk > 0) {
+                #pragma omp for schedule(dynamic, chunk)
+                for (int i = 0; i < n; ++i) accel[i] = live(i) ? accelOf(i, background, local) : Vec(T(0));
+            } else {
+                #pragma omp for schedule(static)
+                for (int i = 0; i < n; ++i) accel[i] = live(i) ? accelOf(i, background, local) : Vec(T(0));
+            }
+            #pragma omp critical
+            total += local;
+        }
+        *counters = total;
+    }
+
+    const T h = dt, keep = T(1) - T(damping);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; ++i) {
+        Particle& v = view[i];
+        if (isDead(v)) continue;
+        BasicParticle<T, D>& p = particles[i];
+        if (toView(p.velocity) != v.velocity) p.velocity = fromView(v.velocity); // kicked by a tool
+        lastAccel[i] = glm::length(accel[i]);
+        p.velocity += accel[i] * h;
+        p.velocity *= keep;
+        p.position += p.velocity * h;
+        v.position = toView(p.position);
+        v.velocity = toView(p.velocity);
+    }
+}
+
+template class ShadowSystem<double, 3>;
+template class ShadowSystem<float, 2>;
+template class ShadowSystem<double, 2>;
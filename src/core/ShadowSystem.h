@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "Particle.h"
+#include "BarnesHut.h"
+#include "BackgroundPotential.h"
+
+// Gravity and integration at another scalar type or dimension than the float
+// 3D particles every other pass works on. The float array is a view of this
+// state: a slot whose view no longer equals its rounded shadow (moved by a
+// tool or a collision, respawned, compacted) is read back from it, so the
+// passes on the view need no changes. In 2D the shadow is the x-z plane of
+// the view (the galactic disc) with y held at 0, and pairs still attract as
+// 1/r^2: a razor-thin disc on a quadtree.
+// Instantiated for <double, 3>, <float, 2> and <double, 2>.
+template <typename T, int D>
+class ShadowSystem {
+public:
+    using Vec = glm::vec<D, T>;
+
+    void clear() { particles.clear(); heavy.clear(); lastAccel.clear(); }
+    // Masses and flags always, positions and velocities where the view was edited
+    void sync(const ParticleArray& view);
+    // Builds when asked or when the tree does not cover the current slots
+    // (first step on this path, count changed), refits when asked otherwise
+    void updateTree(const BarnesHutParams& p, bool rebuild, bool refit);
+    // Accelerations from the tree, heavy bodies summed directly and the
+    // background, then kick and drift of every slot alive in the view, taking
+    // velocities the view changed since sync (tools); positions and velocities
+    // are then rounded into the view. Counters are accumulated when given.
+    // chunk: particles per dynamically scheduled chunk, 0 for a static schedule.
+    void step(ParticleArray& view, const BackgroundPotential& background, float dt, float damping, int chunk,
+              TraversalCounters* counters);
+    // Acceleration of slot i at the synced positions, in the view's frame
+    glm::vec3 acceleration(int i, const BackgroundPotential& background) const;
+
+    static Vec fromView(const glm::vec3& v);
+    static glm::vec3 toView(const Vec& v);
+
+private:
+    BasicParticleArray<T, D> particles;
+    BasicBarnesHut<T, D> tree;
+    BarnesHutParams params;
+    std::vector<int> heavy; // live heavy bodies, refreshed by sync
+    std::vector<T> lastAccel; // |a| of the previous step, for the relative opening criterion; 0 where sync re-read
+    std::vector<Vec> accel;   // this step's, between the two loops of step
+
+    template <typename Stats>
+    Vec accelOf(int i, const BackgroundPotential& background, Stats& stats) const;
+};
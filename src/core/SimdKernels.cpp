@@ -0,0 +1,159 @@
+#include "SimdKernels.h"
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_KERNELS_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// One per variant translation unit (SimdKernels.inl)
+extern const SimdKernels kSimdKernelsSse2;
+extern const SimdKernels kSimdKernelsSse42;
+extern const SimdKernels kSimdKernelsAvx2;
+extern const SimdKernels kSimdKernelsAvx512;
+
+namespace {
+
+struct CpuInfo {
+    bool sse42 = false, avx2 = false, avx512 = false;
+    char brand[49] = {};
+};
+
+#ifdef SIMD_KERNELS_X86
+void cpuid(unsigned leaf, unsigned sub, unsigned r[4]) {
+#if defined(_MSC_VER)
+    int v[4];
+    __cpuidex(v, (int)leaf, (int)sub);
+    for (int k = 0; k < 4; ++k) r[k] = (unsigned)v[k];
+#else
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+// Register state the OS saves on context switches (XCR0)
+unsigned long long osSavedState() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+CpuInfo detect() {
+    CpuInfo c;
+#ifdef SIMD_KERNELS_X86
+    unsigned r[4];
+    cpuid(0, 0, r);
+    const unsigned maxLeaf = r[0];
+    cpuid(1, 0, r);
+    const unsigned ecx1 = r[2];
+    c.sse42 = (ecx1 & (1u << 19)) && (ecx1 & (1u << 20));
+    // AVX needs the OS to save YMM (XCR0 bits 1-2), AVX-512 also opmask and ZMM (bits 5-7)
+    const bool osxsave = (ecx1 & (1u << 27)) != 0;
+    const unsigned long long xcr0 = osxsave ? osSavedState() : 0;
+    const bool ymm = (xcr0 & 0x6) == 0x6, zmm = (xcr0 & 0xE6) == 0xE6;
+    const bool avx = (ecx1 & (1u << 28)) != 0, fma = (ecx1 & (1u << 12)) != 0;
+    unsigned ebx7 = 0;
+    if (maxLeaf >= 7) {
+        cpuid(7, 0, r);
+        ebx7 = r[1];
+    }
+    c.avx2 = c.sse42 && ymm && avx && fma && (ebx7 & (1u << 5));
+    c.avx512 = c.avx2 && zmm && (ebx7 & (1u << 16));
+
+    cpuid(0x80000000u, 0, r);
+    if (r[0] >= 0x80000004u) {
+        for (unsigned k = 0; k < 3; ++k) {
+            cpuid(0x80000002u + k, 0, r);
+            std::memcpy(c.brand + 16 * k, r, 16);
+        }
+        // the brand string is right-aligned on some parts
+        const char* b = c.brand;
+        while (*b == ' ') ++b;
+        std::memmove(c.brand, b, std::strlen(b) + 1);
+    }
+#endif
+    return c;
+}
+
+const CpuInfo& cpu() {
+    static const CpuInfo info = detect();
+    return info;
+}
+
+const SimdKernels* tableOf(SimdIsa isa) {
+    switch (isa) {
+        case SimdIsa::Sse42: return &kSimdKernelsSse42;
+        case SimdIsa::Avx2: return &kSimdKernelsAvx2;
+        case SimdIsa::Avx512: return &kSimdKernelsAvx512;
+        default: return &kSimdKernelsSse2;
+    }
+}
+
+std::atomic<const SimdKernels*> active{ nullptr };
+
+} // namespace
+
+const char* simdIsaName(SimdIsa isa) { return tableOf(isa)->name; }
+
+bool parseSimdIsa(const char* name, SimdIsa& out) {
+    static const struct { const char* name; SimdIsa isa; } kNames[] = {
+        { "sse2", SimdIsa::Sse2 }, { "sse4.2", SimdIsa::Sse42 }, { "avx2", SimdIsa::Avx2 }, { "avx512", SimdIsa::Avx512 },
+    };
+    for (const auto& n : kNames) {
+        if (std::strcmp(name, n.name) == 0) { out = n.isa; return true; }
+    }
+    return false;
+}
+
+bool simdIsaSupported(SimdIsa isa) {
+#ifdef SIMD_KERNELS_X86
+    switch (isa) {
+        case SimdIsa::Sse42:
+#if defined(_MSC_VER)
+            // MSVC gets no SSE4.2 switch (CMakeLists.txt): that table is SSE2 code
+            return false;
+#else
+            return cpu().sse42;
+#endif
+        case SimdIsa::Avx2: return cpu().avx2;
+        case SimdIsa::Avx512: return cpu().avx512;
+        default: return true;
+    }
+#else
+    return isa == SimdIsa::Sse2; // the plain C++ build of every variant
+#endif
+}
+
+SimdIsa bestSimdIsa() {
+    if (simdIsaSupported(SimdIsa::Avx512)) return SimdIsa::Avx512;
+    if (simdIsaSupported(SimdIsa::Avx2)) return SimdIsa::Avx2;
+    if (simdIsaSupported(SimdIsa::Sse42)) return SimdIsa::Sse42;
+    return SimdIsa::Sse2;
+}
+
+const char* cpuBrand() { return cpu().brand; }
+
+const SimdKernels& simdKernels() {
+    const SimdKernels* k = active.load(std::memory_order_acquire);
+    if (!k) {
+        k = tableOf(bestSimdIsa());
+        active.store(k, std::memory_order_release);
+    }
+    return *k;
+}
+
+bool setSimdIsa(SimdIsa isa) {
+    if (!simdIsaSupported(isa)) return false;
+    active.store(tableOf(isa), std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Hot loops compiled once per instruction set and chosen at startup from
+// CPUID, so one binary runs at the widest vectors the CPU and OS support.
+// SimdKernels.inl is built into SimdKernelsSse2/Sse42/Avx2/Avx512.cpp with
+// per-file flags (CMakeLists.txt). Those translation units see only this
+// header and intrinsics: an inline glm or std function instantiated there
+// could be the copy the linker keeps for baseline callers.
+
+enum class SimdIsa {
+    Sse2,  // x86-64 baseline (any other architecture: plain C++)
+    Sse42,
+    Avx2,  // with FMA
+    Avx512 // AVX-512F
+};
+
+// Tree particles in tree order (BarnesHut::particleOrder)
+struct GravitySources {
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* m;
+};
+
+// Interaction lists of one walk: leaf ranges into the sources and accepted nodes as monopoles
+struct GravityList {
+    const int* leafFirst;
+    const int* leafCount;
+    int leaves;
+    const float* cx;
+    const float* cy;
+    const float* cz;
+    const float* cm;
+    int cells;
+};
+
+// Array of structs described by byte offsets, so the kernels need not see Particle
+struct ParticleLayout {
+    unsigned char* base;
+    size_t stride;
+    size_t position, velocity, flags; // float[3], float[3], uint32_t
+};
+
+struct SimdKernels {
+    SimdIsa isa;
+    const char* name;
+    // acc = sum of m (s - p) / (|s - p|^2 + eps2)^(3/2) over the list; sources at p itself add nothing
+    void (*gravity)(const GravitySources& src, const GravityList& list, const float p[3], float eps2, float acc[3]);
+    // Kick of slots [first, first + count) by accel (x, y, z per slot), velocity then scaled by
+    // keep, and drift; slots with any of skipFlags are left alone, box > 0 wraps positions into
+    // the periodic cube
+    void (*integrate)(const ParticleLayout& l, int first, int count, const float* accel, float dt, float keep, float box,
+                      uint32_t skipFlags);
+    // Writes every j in [first, last) whose sphere overlaps sphere i into out; returns how many
+    int (*overlaps)(const float* x, const float* y, const float* z, const float* r, int i, int first, int last, int* out);
+};
+
+const char* simdIsaName(SimdIsa isa);
+bool parseSimdIsa(const char* name, SimdIsa& out);
+// Compiled in and supported by the CPU and the OS (saved vector state);
+// SSE4.2 is never reported on MSVC builds, which compile it as SSE2
+bool simdIsaSupported(SimdIsa isa);
+SimdIsa bestSimdIsa();
+// Processor brand from CPUID, empty where unavailable
+const char* cpuBrand();
+
+// Active set: the best supported one unless setSimdIsa chose another
+const SimdKernels& simdKernels();
+// Switches to isa if supported (returns false otherwise); call before the simulation starts
+bool setSimdIsa(SimdIsa isa);
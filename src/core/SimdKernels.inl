@@ -0,0 +1,212 @@
+// Kernel bodies shared by the SimdKernels*.cpp variants. The including file
+// defines one of SIMD_KERNELS_SSE2 / _SSE42 / _AVX2 / _AVX512 plus the table
+// SIMD_KERNELS_TABLE, its SIMD_KERNELS_ISA and SIMD_KERNELS_NAME. Everything
+// below has internal linkage (see SimdKernels.h).
+#include "SimdKernels.h"
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// The flags come from CMakeLists.txt; without them the variant would quietly be baseline code
+#if defined(SIMD_KERNELS_X86) && defined(SIMD_KERNELS_AVX512) && !defined(__AVX512F__)
+#error "SimdKernelsAvx512.cpp must be compiled with AVX-512F enabled"
+#endif
+#if defined(SIMD_KERNELS_X86) && defined(SIMD_KERNELS_AVX2) && !defined(__AVX2__)
+#error "SimdKernelsAvx2.cpp must be compiled with AVX2 and FMA enabled"
+#endif
+// MSVC has no macro to check here; simdIsaSupported keeps that table unused instead
+#if defined(SIMD_KERNELS_X86) && defined(SIMD_KERNELS_SSE42) && defined(__GNUC__) && !defined(__SSE4_2__)
+#error "SimdKernelsSse42.cpp must be compiled with SSE4.2 enabled"
+#endif
+
+namespace {
+
+// Vector of kWidth floats; vrsqrt is the hardware estimate plus one Newton
+// step (about float precision), lessMask has bit k set where a[k] < b[k]
+#if defined(SIMD_KERNELS_X86) && defined(SIMD_KERNELS_AVX512)
+using vf = __m512;
+constexpr int kWidth = 16;
+inline vf vload(const float* p) { return _mm512_loadu_ps(p); }
+inline vf vloadPartial(const float* p, int n) { return _mm512_maskz_loadu_ps((__mmask16)((1u << n) - 1u), p); }
+inline vf vset(float a) { return _mm512_set1_ps(a); }
+inline vf vadd(vf a, vf b) { return _mm512_add_ps(a, b); }
+inline vf vsub(vf a, vf b) { return _mm512_sub_ps(a, b); }
+inline vf vmul(vf a, vf b) { return _mm512_mul_ps(a, b); }
+inline vf vfma(vf a, vf b, vf c) { return _mm512_fmadd_ps(a, b, c); }
+inline vf vrsqrtEstimate(vf a) { return _mm512_rsqrt14_ps(a); }
+inline vf vkeepPositive(vf test, vf v) { return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(test, _mm512_setzero_ps(), _CMP_GT_OQ), v); }
+inline unsigned vlessMask(vf a, vf b) { return (unsigned)_mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+inline float vsum(vf a) { return _mm512_reduce_add_ps(a); }
+#elif defined(SIMD_KERNELS_X86) && defined(SIMD_KERNELS_AVX2)
+using vf = __m256;
+constexpr int kWidth = 8;
+inline vf vload(const float* p) { return _mm256_loadu_ps(p); }
+inline vf vloadPartial(const float* p, int n) {
+    // masked-off lanes are not read, so the range may end at a page boundary
+    return _mm256_maskload_ps(p, _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+inline vf vset(float a) { return _mm256_set1_ps(a); }
+inline vf vadd(vf a, vf b) { return _mm256_add_ps(a, b); }
+inline vf vsub(vf a, vf b) { return _mm256_sub_ps(a, b); }
+inline vf vmul(vf a, vf b) { return _mm256_mul_ps(a, b); }
+inline vf vfma(vf a, vf b, vf c) { return _mm256_fmadd_ps(a, b, c); }
+inline vf vrsqrtEstimate(vf a) { return _mm256_rsqrt_ps(a); }
+inline vf vkeepPositive(vf test, vf v) { return _mm256_and_ps(_mm256_cmp_ps(test, _mm256_setzero_ps(), _CMP_GT_OQ), v); }
+inline unsigned vlessMask(vf a, vf b) { return (unsigned)_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+inline float vsum(vf a) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+#elif defined(SIMD_KERNELS_X86)
+// SSE2 and SSE4.2 share the vector code; the SSE4.2 build gains the SSE4.1
+// rounding instruction for the periodic wrap instead of a floorf call
+using vf = __m128;
+constexpr int kWidth = 4;
+inline vf vload(const float* p) { return _mm_loadu_ps(p); }
+inline vf vloadPartial(const float* p, int n) {
+    float t[kWidth] = {};
+    for (int k = 0; k < n; ++k) t[k] = p[k];
+    return _mm_loadu_ps(t);
+}
+inline vf vset(float a) { return _mm_set1_ps(a); }
+inline vf vadd(vf a, vf b) { return _mm_add_ps(a, b); }
+inline vf vsub(vf a, vf b) { return _mm_sub_ps(a, b); }
+inline vf vmul(vf a, vf b) { return _mm_mul_ps(a, b); }
+inline vf vfma(vf a, vf b, vf c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline vf vrsqrtEstimate(vf a) { return _mm_rsqrt_ps(a); }
+inline vf vkeepPositive(vf test, vf v) { return _mm_and_ps(_mm_cmpgt_ps(test, _mm_setzero_ps()), v); }
+inline unsigned vlessMask(vf a, vf b) { return (unsigned)_mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+inline float vsum(vf s) {
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+#else
+// Not x86: plain C++, every variant compiles to the same code
+using vf = float;
+constexpr int kWidth = 1;
+inline vf vload(const float* p) { return *p; }
+inline vf vloadPartial(const float* p, int) { return *p; }
+inline vf vset(float a) { return a; }
+inline vf vadd(vf a, vf b) { return a + b; }
+inline vf vsub(vf a, vf b) { return a - b; }
+inline vf vmul(vf a, vf b) { return a * b; }
+inline vf vfma(vf a, vf b, vf c) { return a * b + c; }
+inline vf vrsqrtEstimate(vf a) { return 1.0f / sqrtf(a); }
+inline vf vkeepPositive(vf test, vf v) { return (test > 0.0f) ? v : 0.0f; }
+inline unsigned vlessMask(vf a, vf b) { return (a < b) ? 1u : 0u; }
+inline float vsum(vf a) { return a; }
+#endif
+
+inline vf vrsqrt(vf a) {
+    vf y = vrsqrtEstimate(a);
+    return vmul(y, vsub(vset(1.5f), vmul(vmul(vset(0.5f), a), vmul(y, y))));
+}
+
+inline int lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long k;
+    _BitScanForward(&k, mask);
+    return (int)k;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+struct Accum {
+    vf x, y, z;
+};
+
+// r2 = 0 (the particle itself, or an empty padding lane at p) is dropped
+// before it can turn into inf * 0
+inline void interact(vf sx, vf sy, vf sz, vf sm, vf px, vf py, vf pz, vf eps2, Accum& a) {
+    const vf dx = vsub(sx, px), dy = vsub(sy, py), dz = vsub(sz, pz);
+    const vf r2 = vfma(dx, dx, vfma(dy, dy, vmul(dz, dz)));
+    const vf inv = vrsqrt(vadd(r2, eps2));
+    const vf w = vkeepPositive(r2, vmul(sm, vmul(inv, vmul(inv, inv))));
+    a.x = vfma(w, dx, a.x);
+    a.y = vfma(w, dy, a.y);
+    a.z = vfma(w, dz, a.z);
+}
+
+// Zero-mass lanes past n add nothing
+inline void accumulate(const float* x, const float* y, const float* z, const float* m, int n,
+                       vf px, vf py, vf pz, vf eps2, Accum& a) {
+    int k = 0;
+    for (; k + kWidth <= n; k += kWidth) interact(vload(x + k), vload(y + k), vload(z + k), vload(m + k), px, py, pz, eps2, a);
+    if (k < n) {
+        const int rest = n - k;
+        interact(vloadPartial(x + k, rest), vloadPartial(y + k, rest), vloadPartial(z + k, rest), vloadPartial(m + k, rest),
+                 px, py, pz, eps2, a);
+    }
+}
+
+void gravity(const GravitySources& src, const GravityList& list, const float p[3], float eps2, float acc[3]) {
+    const vf px = vset(p[0]), py = vset(p[1]), pz = vset(p[2]), e = vset(eps2);
+    Accum a{ vset(0.0f), vset(0.0f), vset(0.0f) };
+    for (int q = 0; q < list.leaves; ++q) {
+        const int f = list.leafFirst[q];
+        accumulate(src.x + f, src.y + f, src.z + f, src.m + f, list.leafCount[q], px, py, pz, e, a);
+    }
+    accumulate(list.cx, list.cy, list.cz, list.cm, list.cells, px, py, pz, e, a);
+    acc[0] = vsum(a.x);
+    acc[1] = vsum(a.y);
+    acc[2] = vsum(a.z);
+}
+
+// One axis of the kick and drift, on values held in registers
+inline void kickDrift(float& x, float& v, float a, float dt, float keep, float box) {
+    v = (v + a * dt) * keep;
+    x += v * dt;
+    if (box > 0.0f) x -= box * floorf(x / box + 0.5f);
+}
+
+// Strided and memory bound: the variants differ in code generation only
+// (VEX encoding, FMA contraction, SSE4.1 rounding for the wrap). The layout
+// is copied and the fields go through locals because, as far as the compiler
+// knows, every store may alias any of them.
+void integrate(const ParticleLayout& layout, int first, int count, const float* accel, float dt, float keep, float box,
+               uint32_t skipFlags) {
+    const ParticleLayout l = layout;
+    for (int i = first; i < first + count; ++i) {
+        unsigned char* p = l.base + (size_t)i * l.stride;
+        if (*(const uint32_t*)(p + l.flags) & skipFlags) continue;
+        float* pos = (float*)(p + l.position);
+        float* vel = (float*)(p + l.velocity);
+        const float* a = accel + 3 * (i - first);
+        float x0 = pos[0], x1 = pos[1], x2 = pos[2], v0 = vel[0], v1 = vel[1], v2 = vel[2];
+        kickDrift(x0, v0, a[0], dt, keep, box);
+        kickDrift(x1, v1, a[1], dt, keep, box);
+        kickDrift(x2, v2, a[2], dt, keep, box);
+        pos[0] = x0; pos[1] = x1; pos[2] = x2;
+        vel[0] = v0; vel[1] = v1; vel[2] = v2;
+    }
+}
+
+int overlaps(const float* x, const float* y, const float* z, const float* r, int i, int first, int last, int* out) {
+    const vf px = vset(x[i]), py = vset(y[i]), pz = vset(z[i]), pr = vset(r[i]);
+    int n = 0;
+    int j = first;
+    for (; j + kWidth <= last; j += kWidth) {
+        const vf dx = vsub(vload(x + j), px), dy = vsub(vload(y + j), py), dz = vsub(vload(z + j), pz);
+        const vf reach = vadd(vload(r + j), pr);
+        unsigned mask = vlessMask(vfma(dx, dx, vfma(dy, dy, vmul(dz, dz))), vmul(reach, reach));
+        for (; mask; mask &= mask - 1u) out[n++] = j + lowestBit(mask);
+    }
+    for (; j < last; ++j) {
+        const float dx = x[j] - x[i], dy = y[j] - y[i], dz = z[j] - z[i];
+        const float reach = r[j] + r[i];
+        if (dx * dx + dy * dy + dz * dz < reach * reach) out[n++] = j;
+    }
+    return n;
+}
+
+} // namespace
+
+extern const SimdKernels SIMD_KERNELS_TABLE = { SIMD_KERNELS_ISA, SIMD_KERNELS_NAME, &gravity, &integrate, &overlaps };
@@ -0,0 +1,6 @@
+// AVX2 + FMA variant of SimdKernels.inl, built with -mavx2 -mfma or /arch:AVX2 (CMakeLists.txt)
+#define SIMD_KERNELS_AVX2
+#define SIMD_KERNELS_TABLE kSimdKernelsAvx2
+#define SIMD_KERNELS_ISA SimdIsa::Avx2
+#define SIMD_KERNELS_NAME "AVX2"
+#include "SimdKernels.inl"
@@ -0,0 +1,6 @@
+// AVX-512F variant of SimdKernels.inl, built with -mavx512f -mfma or /arch:AVX512 (CMakeLists.txt)
+#define SIMD_KERNELS_AVX512
+#define SIMD_KERNELS_TABLE kSimdKernelsAvx512
+#define SIMD_KERNELS_ISA SimdIsa::Avx512
+#define SIMD_KERNELS_NAME "AVX-512"
+#include "SimdKernels.inl"
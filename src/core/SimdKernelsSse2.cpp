@@ -0,0 +1,6 @@
+// SSE2 (x86-64 baseline) variant of SimdKernels.inl, built without extra flags
+#define SIMD_KERNELS_SSE2
+#define SIMD_KERNELS_TABLE kSimdKernelsSse2
+#define SIMD_KERNELS_ISA SimdIsa::Sse2
+#define SIMD_KERNELS_NAME "SSE2"
+#include "SimdKernels.inl"
@@ -0,0 +1,7 @@
+// SSE4.2 variant of SimdKernels.inl, built with -msse4.2 (CMakeLists.txt);
+// MSVC builds it without a switch and never selects it (simdIsaSupported)
+#define SIMD_KERNELS_SSE42
+#define SIMD_KERNELS_TABLE kSimdKernelsSse42
+#define SIMD_KERNELS_ISA SimdIsa::Sse42
+#define SIMD_KERNELS_NAME "SSE4.2"
+#include "SimdKernels.inl"
@@ -2,182 +2,795 @@
 #include <glm/gtc/constants.hpp>
 #include <glm/gtx/norm.hpp>
 #include <algorithm>
-#include <unordered_map>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "AllocationTracker.h"
+#include "Regularization.h"
+#include "SimdKernels.h"
 
-SimulationEngine::SimulationEngine() : rng(std::random_device{}()) {}
+// Attributes one phase of update() to the allocation tracker, the wall clock
+// and, when open, the hardware counters
+class SimulationEngine::PhaseScope {
+public:
+    PhaseScope(SimulationEngine& e, FramePhase p)
+        : engine(e), phase(p), alloc(p), t0(std::chrono::steady_clock::now()) {
+        if (engine.profile.hasCounters) engine.perf.start();
+    }
+    ~PhaseScope() {
+        PhaseStats& st = engine.profile[phase];
+        if (engine.profile.hasCounters) st.counters += engine.perf.stop();
+        st.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+private:
+    SimulationEngine& engine;
+    FramePhase phase;
+    AllocationTracker::PhaseScope alloc;
+    std::chrono::steady_clock::time_point t0;
+};
+
+SimulationEngine::SimulationEngine() : rng(std::random_device{}()) {
+    solverLoaded = solver.load(SolverProfile::kDefaultPath);
+}
+
+// The double and 2D paths run the open-boundary tree only
+static bool shadowed(const SimulationSettings& s) {
+    return s.precision != ScalarPrecision::Single || s.dimensions == 2;
+}
+
+static GravitySolver solverOf(const SimulationSettings& s) {
+    return shadowed(s) ? GravitySolver::Tree : s.gravitySolver;
+}
+
+static PMParams pmParams(const SimulationSettings& s) {
+    PMParams p;
+    p.grid = 8;
+    while (p.grid < std::min(s.pmGrid, 256)) p.grid <<= 1;
+    p.boxSize = s.boxSize;
+    p.G = s.gravityG;
+    if (solverOf(s) == GravitySolver::TreePM) p.splitScale = s.pmSplitCells * s.boxSize / (float)p.grid;
+    return p;
+}
+
+// Byte layout of Particle for the SimdKernels, which do not see glm
+static ParticleLayout particleLayout(ParticleArray& particles) {
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "SimdKernels read a vec3 as float[3]");
+    return { reinterpret_cast<unsigned char*>(particles.data()), sizeof(Particle), offsetof(Particle, position),
+             offsetof(Particle, velocity), offsetof(Particle, flags) };
+}
+
+// Into [-box/2, box/2) on every axis
+static glm::vec3 wrapPeriodic(const glm::vec3& p, float box) {
+    return p - box * glm::floor(p / box + 0.5f);
+}
+
+BarnesHutParams SimulationEngine::treeParams(const SimulationSettings& s) const {
+    BarnesHutParams p;
+    p.G = s.gravityG; p.softening = s.softening; p.theta = s.theta; p.coulombK = s.coulombK;
+    p.kernel = s.softeningKernel; p.opening = s.openingCriterion; p.accelTolerance = s.accelTolerance;
+    if (solverOf(s) == GravitySolver::TreePM) {
+        p.periodicBox = s.boxSize;
+        p.splitScale = s.pmSplitCells * s.boxSize / (float)pmParams(s).grid;
+    }
+    p.maxLeafSize = solver.maxLeafSize;
+    p.buildTaskCutoff = solver.buildTaskCutoff;
+    p.listGroupSize = std::max(0, s.interactionListGroup);
+    return p;
+}
+
+// Runs f on the shadow state the settings select; false on the float 3D path
+template <typename F>
+bool SimulationEngine::withShadow(const SimulationSettings& s, F&& f) {
+    if (!shadowed(s)) return false;
+    const bool dbl = s.precision == ScalarPrecision::Double;
+    if (s.dimensions == 2) {
+        if (dbl) f(shadowD2); else f(shadowF2);
+    } else {
+        f(shadowD3);
+    }
+    return true;
+}
 
 void SimulationEngine::reset(const SimulationSettings& s) {
-    particles.clear();
-    particles.shrink_to_fit();
-    BarnesHutParams p; p.G = s.gravityG; p.softening = s.softening; p.theta = s.theta;
-    bh = BarnesHut(p);
-    lastBhParams = p; frameCounter = 0; lastParticleCount = 0;
+    store.clear();
+    shadowD3.clear(); shadowF2.clear(); shadowD2.clear();
+    PageAllocator::setHugePageMode(s.hugePages);
+    BarnesHutParams p = treeParams(s);
+    bh.setParams(p);
+    bhNext.setParams(p);
+    nextTreeReady = false;
+    lastBhParams = p; frameCounter = 0; lastParticleCount = 0; pendingToolCount = 0;
+    worldFrame = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
 
     switch (s.module) {
-        case SimulationModule::Galaxy: initGalaxy(s.particleCount); break;
+        case SimulationModule::Galaxy: initGalaxy(s.particleCount, s.tracerFraction); break;
         case SimulationModule::BlackHole: initBlackHole(s.particleCount); break;
         case SimulationModule::Supernova: initSupernova(s.particleCount); break;
         case SimulationModule::Interactions: initInteractions(s.particleCount); break;
+        case SimulationModule::UniformBox: initUniformBox(s.particleCount, s.boxSize); break;
     }
+    store.adopt();
+    maxParticleRadius = 0.0f;
+    for (const Particle& pt : particles) maxParticleRadius = std::max(maxParticleRadius, pt.radius);
+    clearPick();
+    encounters.clear();
+    pagePlacement = PageAllocator::queryPlacement(particles.data(), particles.size() * sizeof(Particle));
+    numaSpread = std::count_if(pagePlacement.pagesPerNode.begin(), pagePlacement.pagesPerNode.end(),
+                               [](size_t pages) { return pages > 0; }) > 1;
 }
 
 void SimulationEngine::update(const SimulationSettings& s) {
-    BarnesHutParams p; p.G = s.gravityG; p.softening = s.softening; p.theta = s.theta;
-    bool paramsChanged = (p.G != lastBhParams.G) || (p.softening != lastBhParams.softening) || (p.theta != lastBhParams.theta);
-    bool countChanged = (particles.size() != lastParticleCount);
-    if (paramsChanged) { bh = BarnesHut(p); lastBhParams = p; }
-    if (paramsChanged || countChanged || (s.rebuildEveryN <= 1) || (frameCounter % s.rebuildEveryN == 0)) {
-        bh.build(particles);
-        lastParticleCount = particles.size();
+    // (re)open counters when the request changes; failure is reported via getPerfCounters().status()
+    if (s.hardwareCounters != perfRequested || s.hardwareCountersPerThread != perfPerThread) {
+        perfRequested = s.hardwareCounters;
+        perfPerThread = s.hardwareCountersPerThread;
+        if (perfRequested) perf.open(perfPerThread); else perf.close();
     }
+    profile = FrameProfile{};
+    profile.particles = particles.size();
+    profile.hasCounters = perf.available();
 
-    // zero forces
-    for (auto& pt : particles) pt.force = glm::vec3(0.0f);
+    {
+        PhaseScope phase(*this, FramePhase::Build);
+        BarnesHutParams p = treeParams(s);
+        bool paramsChanged = (p.G != lastBhParams.G) || (p.softening != lastBhParams.softening) || (p.theta != lastBhParams.theta)
+                          || (p.coulombK != lastBhParams.coulombK) || (p.splitScale != lastBhParams.splitScale)
+                          || (p.kernel != lastBhParams.kernel) || (p.opening != lastBhParams.opening)
+                          || (p.accelTolerance != lastBhParams.accelTolerance)
+                          || (p.periodicBox != lastBhParams.periodicBox)
+                          || (p.maxLeafSize != lastBhParams.maxLeafSize) || (p.buildTaskCutoff != lastBhParams.buildTaskCutoff)
+                          || (p.listGroupSize != lastBhParams.listGroupSize);
+        bool countChanged = (particles.size() != lastParticleCount);
+        if (paramsChanged) { bh.setParams(p); bhNext.setParams(p); lastBhParams = p; }
+        treeCurrent = true;
+        const bool rebuild = paramsChanged || countChanged || (s.rebuildEveryN <= 1) || (frameCounter % s.rebuildEveryN == 0);
+        // the tree the last force pass built stands in for the build; the
+        // refit replaces its predicted boxes and moments with the real ones
+        const bool prebuilt = rebuild && nextTreeReady && !paramsChanged && nextTreeLayout == store.layoutVersion();
+        nextTreeReady = false;
+        if (prebuilt) {
+            std::swap(bh, bhNext);
+            bh.refit(particles);
+            if (s.treeStats) bh.collectStructure(treeStats);
+        } else if (rebuild) {
+            bh.build(particles);
+            lastParticleCount = particles.size();
+            if (s.treeStats) bh.collectStructure(treeStats);
+        } else if (s.refitBetweenBuilds) {
+            bh.refit(particles);
+        } else {
+            treeCurrent = false;
+            bh.refreshSources(particles); // stale moments, but current leaf particles
+        }
+        if (s.treeStats) {
+            treeStats.lists = bh.listCount();
+            treeStats.listsRewalked = bh.listsRewalked();
+        }
+        withShadow(s, [&](auto& shadow) {
+            shadow.sync(particles);
+            shadow.updateTree(p, rebuild, s.refitBetweenBuilds);
+        });
+    }
 
-    // compute forces (parallel)
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < (int)particles.size(); ++i) {
-        particles[i].force = particles[i].mass * bh.computeForce(i, particles);
+    periodicBox = (solverOf(s) != GravitySolver::Tree) ? s.boxSize : 0.0f;
+    if (periodicBox > 0.0f) {
+        PhaseScope phase(*this, FramePhase::Mesh);
+        pm.setParams(pmParams(s));
+        pm.computeAccelerations(particles, meshAccel);
+    }
+
+    // Everything that queries the tree runs before the force pass, which
+    // moves particles as it goes: absorption, picking and the tools
+    if (s.module == SimulationModule::BlackHole) {
+        PhaseScope phase(*this, FramePhase::Horizon);
+        applyBlackHoleEventHorizon();
     }
 
-    // interactive tool
-    if (s.toolEngaged && s.tool != InteractionTool::None && s.toolRadius > 0.0f) {
-        applyInteractiveTool(s);
+    if (pickRequested || pickInfo.id != kInvalidParticleId) {
+        PhaseScope phase(*this, FramePhase::Tool);
+        updatePick(s);
     }
 
-    integrate(s);
-    if (s.collisions) handleCollisions(s.restitution);
-    if (s.module == SimulationModule::BlackHole) applyBlackHoleEventHorizon();
+    // interactive tools
+    if (pendingToolCount > 0 || (s.toolEngaged && s.tool != InteractionTool::None && s.toolRadius > 0.0f)) {
+        PhaseScope phase(*this, FramePhase::Tool);
+        applyTools(s);
+    }
+
+    {
+        PhaseScope phase(*this, FramePhase::Force);
+        updateEncounters(s);
+        bool shadowStep = withShadow(s, [&](auto& shadow) {
+            shadow.step(particles, s.background, s.timeStep, s.damping, forceChunk(),
+                        s.treeStats ? &treeStats.traversal : nullptr);
+            treeStats.particlesWalked = particles.size();
+        });
+        if (!shadowStep) {
+            gatherHeavyBodies();
+            const bool buildNext = pipelineBuild(s);
+            if (buildNext) {
+                // tools have kicked already; the acceleration of this step is left out
+                const int n = (int)particles.size();
+                const float dt = s.timeStep;
+                predicted.resize(n);
+                #pragma omp parallel for schedule(static)
+                for (int i = 0; i < n; ++i) {
+                    glm::vec3 x = particles[i].position + particles[i].velocity * dt;
+                    predicted[i] = periodicBox > 0.0f ? wrapPeriodic(x, periodicBox) : x;
+                }
+            }
+            if (s.treeStats) forceKickDrift(s, &treeStats, buildNext);
+            else forceKickDrift<NoTraversalStats>(s, nullptr, buildNext);
+            nextTreeReady = buildNext;
+            nextTreeLayout = store.layoutVersion();
+        }
+    }
+
+    if (!encounters.empty()) {
+        PhaseScope phase(*this, FramePhase::Integrate);
+        integrateEncounters(s);
+    }
+    if (s.collisions && (s.collisionEveryN <= 1 || frameCounter % s.collisionEveryN == 0)) {
+        PhaseScope phase(*this, FramePhase::Collisions);
+        handleCollisions(s.restitution);
+    }
+    // tombstones are reused by spawns; compact once too many pile up
+    if (store.deadCount() > 0 && (double)store.deadCount() > s.compactDeadFraction * (double)particles.size()) {
+        PhaseScope phase(*this, FramePhase::Horizon);
+        compactDead();
+    }
     ++frameCounter;
 }
 
-void SimulationEngine::applyInteractiveTool(const SimulationSettings& s) {
-    const glm::vec3 center = s.toolWorld;
-    const float radius = s.toolRadius;
-    const float r2 = radius * radius;
-    const float k = s.toolStrength;
+// Relative orbit energy of two bodies, negative when bound
+static float pairEnergy(const Particle& a, const Particle& b, float G) {
+    glm::vec3 v = b.velocity - a.velocity;
+    return 0.5f * glm::dot(v, v) - G * (a.mass + b.mass) / std::max(glm::distance(a.position, b.position), 1e-6f);
+}
 
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < (int)particles.size(); ++i) {
-        Particle& p = particles[i];
-        glm::vec3 d = center - p.position;
-        float dist2 = glm::dot(d, d) + 1e-6f;
-        if (dist2 > r2) continue;
-        float dist = sqrtf(dist2);
-        glm::vec3 n = d / dist;
-        glm::vec3 f(0.0f);
-        switch (s.tool) {
-            case InteractionTool::Attract:
-                f = n * (k * p.mass / dist2);
-                break;
-            case InteractionTool::Repel:
-                f = -n * (fabsf(k) * p.mass / dist2);
-                break;
-            case InteractionTool::Drag: {
-                float springK = fabsf(k);
-                glm::vec3 spring = springK * (center - p.position);
-                glm::vec3 damping = -0.5f * springK * p.velocity;
-                f = spring + damping;
-            } break;
-            default: break;
+// Heavy bodies are few, so candidate pairs are tested all against all.
+// Pairs form when bound and within encounterRadius and break when unbound
+// or beyond twice that radius.
+void SimulationEngine::updateEncounters(const SimulationSettings& s) {
+    if (heavyLayout != store.layoutVersion()) {
+        heavyLayout = store.layoutVersion();
+        heavySlots.clear();
+        for (int i = 0; i < (int)particles.size(); ++i) if (isHeavy(particles[i])) heavySlots.push_back(i);
+    }
+    for (int i : heavySlots) particles[i].flags &= ~kParticleRegularized;
+    if (s.encounterRadius <= 0.0f || shadowed(s)) { encounters.clear(); return; }
+
+    auto keep = [&](Encounter& e) {
+        e.slotA = store.slotOf(e.a);
+        e.slotB = store.slotOf(e.b);
+        if (e.slotA < 0 || e.slotB < 0) return false;
+        const Particle& a = particles[e.slotA];
+        const Particle& b = particles[e.slotB];
+        return glm::distance(a.position, b.position) < 2.0f * s.encounterRadius && pairEnergy(a, b, s.gravityG) < 0.0f;
+    };
+    encounters.erase(std::remove_if(encounters.begin(), encounters.end(), [&](Encounter& e) { return !keep(e); }), encounters.end());
+    for (const Encounter& e : encounters) {
+        particles[e.slotA].flags |= kParticleRegularized;
+        particles[e.slotB].flags |= kParticleRegularized;
+    }
+    for (size_t x = 0; x < heavySlots.size(); ++x) {
+        const int i = heavySlots[x];
+        if ((particles[i].flags & kParticleRegularized) || isDead(particles[i])) continue;
+        int best = -1;
+        float bestDist = s.encounterRadius;
+        for (size_t y = x + 1; y < heavySlots.size(); ++y) {
+            const int j = heavySlots[y];
+            if ((particles[j].flags & kParticleRegularized) || isDead(particles[j])) continue;
+            float d = glm::distance(particles[i].position, particles[j].position);
+            if (d < bestDist && pairEnergy(particles[i], particles[j], s.gravityG) < 0.0f) { bestDist = d; best = j; }
         }
-        float t = 1.0f - (dist / radius);
-        t = glm::clamp(t, 0.0f, 1.0f);
-        f *= t * t;
-        p.force += f;
+        if (best < 0) continue;
+        encounters.push_back({ store.idOf(i), store.idOf(best), i, best });
+        particles[i].flags |= kParticleRegularized;
+        particles[best].flags |= kParticleRegularized;
     }
 }
 
-void SimulationEngine::integrate(const SimulationSettings& s) {
-    float dt = s.timeStep;
-    float damp = s.damping;
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < (int)particles.size(); ++i) {
-        auto& pt = particles[i];
-        glm::vec3 accel = (pt.mass > 0.0f) ? (pt.force / pt.mass) : glm::vec3(0.0f);
-        pt.velocity += accel * dt;
-        pt.velocity *= (1.0f - damp);
-        pt.position += pt.velocity * dt;
+void SimulationEngine::gatherHeavyBodies() {
+    heavyPos.clear();
+    heavyMass.clear();
+    heavyOwners.clear();
+    for (int i : heavySlots) {
+        const Particle& h = particles[i];
+        if (isDead(h) || (h.flags & kParticleRegularized)) continue;
+        heavyPos.push_back(h.position);
+        heavyMass.push_back(h.mass);
+        heavyOwners.push_back(glm::ivec2(i));
+    }
+    for (const Encounter& e : encounters) {
+        const Particle& a = particles[e.slotA];
+        const Particle& b = particles[e.slotB];
+        float m = a.mass + b.mass;
+        heavyPos.push_back((a.mass * a.position + b.mass * b.position) / m);
+        heavyMass.push_back(m);
+        heavyOwners.push_back(glm::ivec2(e.slotA, e.slotB));
     }
 }
 
-void SimulationEngine::handleCollisions(float restitution) {
-    struct CellKey { int x,y,z; };
-    struct KeyHash {
-        size_t operator()(const CellKey& k) const noexcept {
-            // mix 3 ints into a size_t (64-bit friendly hash)
-            size_t h = (uint32_t)k.x * 73856093u ^ (uint32_t)k.y * 19349663u ^ (uint32_t)k.z * 83492791u;
-            return h;
+// Heavy bodies summed directly, the analytic background and the mesh force, per unit mass
+glm::vec3 SimulationEngine::externalAccel(int i, const SimulationSettings& s) const {
+    const glm::vec3 pos = particles[i].position;
+    const float eps2 = s.softening * s.softening;
+    glm::vec3 a(0.0f);
+    const int nHeavy = (int)heavyPos.size();
+    for (int k = 0; k < nHeavy; ++k) {
+        glm::vec3 r = heavyPos[k] - pos;
+        if (periodicBox > 0.0f) r -= periodicBox * glm::round(r / periodicBox);
+        float d2 = glm::dot(r, r) + eps2;
+        bool own = heavyOwners[k].x == i || heavyOwners[k].y == i; // self, or own pair
+        float w = own ? 0.0f : s.gravityG * heavyMass[k] / (d2 * sqrtf(d2));
+        a += w * r;
+    }
+    if (s.background.type != BackgroundPotentialType::None) a += backgroundAccel(s.background, s.gravityG, s.softening, pos);
+    if (periodicBox > 0.0f) a += meshAccel[i];
+    return a;
+}
+
+// Tree walk (none under PM) plus externalAccel; the tools are kicked in beforehand
+template <typename Stats>
+glm::vec3 SimulationEngine::accelerationOf(int i, const SimulationSettings& s, Stats& stats) const {
+    glm::vec3 a = externalAccel(i, s);
+    if (solverOf(s) != GravitySolver::PM) {
+        const bool relative = s.openingCriterion == OpeningCriterion::RelativeAcceleration && i < (int)lastAccel.size();
+        a += bh.computeForce(i, particles, stats, relative ? lastAccel[i] : 0.0f);
+    }
+    return a;
+}
+
+// Whether this step's force pass builds the tree of the next one: only when
+// that step rebuilds, and with a thread to spare
+bool SimulationEngine::pipelineBuild(const SimulationSettings& s) const {
+    if (!s.pipelineBuild || shadowed(s)) return false;
+    if (s.rebuildEveryN > 1 && (frameCounter + 1) % s.rebuildEveryN != 0) return false;
+#ifdef _OPENMP
+    return omp_get_max_threads() > 1;
+#else
+    return false;
+#endif
+}
+
+// One pass per step: each block of slots walks the tree, then kicks and
+// drifts with the accelerations still in registers or L1, so a particle is
+// streamed once and no force is stored. Other particles are seen only through
+// the tree's own copies and heavyPos, so moving a block while other threads
+// still walk is safe. Regularized pairs are skipped for integrateEncounters.
+// Counters are accumulated per thread and merged once; with NoTraversalStats
+// the bookkeeping compiles away. With buildNext the first thread to arrive
+// builds bhNext at predicted instead; its subtree tasks are taken up by the
+// threads that run out of blocks, and it joins the loop for what is left.
+template <typename Stats>
+void SimulationEngine::forceKickDrift(const SimulationSettings& s, Stats* stats, bool buildNext) {
+    (void)stats;
+    constexpr bool kCounted = !std::is_same_v<Stats, NoTraversalStats>;
+    using Counters = std::conditional_t<kCounted, TraversalCounters, NoTraversalStats>;
+    constexpr int kBlock = 64;
+    const int n = (int)particles.size();
+    const int blocks = (n + kBlock - 1) / kBlock;
+    // Walk costs vary with local density, so blocks are balanced dynamically,
+    // unless the particle pages were spread over NUMA nodes by first touch
+    const int chunk = forceChunk() > 0 ? std::max(1, forceChunk() / kBlock) : 0;
+    const bool relative = s.openingCriterion == OpeningCriterion::RelativeAcceleration;
+    if (relative) lastAccel.resize(n, 0.0f); // 0 = unknown: the first walk opens by theta
+    else lastAccel.clear();
+    const SimdKernels& simd = simdKernels();
+    const ParticleLayout layout = particleLayout(particles);
+    const float dt = s.timeStep, keep = 1.0f - s.damping;
+
+    auto block = [&](int b, Counters& counters) {
+        const int first = b * kBlock, count = std::min(kBlock, n - first);
+        float accel[3 * kBlock];
+        for (int k = 0; k < count; ++k) {
+            const int i = first + k;
+            const Particle& p = particles[i];
+            glm::vec3 a(0.0f);
+            if (!(p.flags & kParticleRegularized)) {
+                if (p.mass > 0.0f) a = accelerationOf(i, s, counters);
+                if (relative) lastAccel[i] = glm::length(a);
+            }
+            accel[3 * k] = a.x; accel[3 * k + 1] = a.y; accel[3 * k + 2] = a.z;
+        }
+        simd.integrate(layout, first, count, accel, dt, keep, periodicBox, kParticleRegularized);
+    };
+    TraversalCounters total;
+    #pragma omp parallel
+    {
+        Counters local;
+        if (buildNext) {
+            #pragma omp single nowait
+            bhNext.build(particles, predicted.data());
+        }
+        if (chunk > 0) {
+            #pragma omp for schedule(dynamic, chunk)
+            for (int b = 0; b < blocks; ++b) block(b, local);
+        } else {
+            // a pipelined build's tasks are taken up at the loop's barrier
+            #pragma omp for schedule(static)
+            for (int b = 0; b < blocks; ++b) block(b, local);
+        }
+        if constexpr (kCounted) {
+            #pragma omp critical
+            total += local;
+        }
+    }
+    if constexpr (kCounted) {
+        stats->traversal = total;
+        stats->particlesWalked = particles.size();
+    }
+}
+
+void SimulationEngine::sampleAccelerations(const SimulationSettings& s, const std::vector<int>& slots, std::vector<glm::vec3>& out) {
+    const BarnesHutParams p = treeParams(s);
+    bh.setParams(p);
+    bhNext.setParams(p);
+    nextTreeReady = false;
+    lastBhParams = p;
+    bh.build(particles);
+    lastParticleCount = particles.size();
+    treeCurrent = true;
+    periodicBox = (solverOf(s) != GravitySolver::Tree) ? s.boxSize : 0.0f;
+    if (periodicBox > 0.0f) {
+        pm.setParams(pmParams(s));
+        pm.computeAccelerations(particles, meshAccel);
+    }
+    out.assign(slots.size(), glm::vec3(0.0f));
+    const int count = (int)slots.size();
+    bool shadow = withShadow(s, [&](auto& sh) {
+        sh.sync(particles);
+        sh.updateTree(p, true, false);
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int k = 0; k < count; ++k) {
+            if (!isDead(particles[slots[k]])) out[k] = sh.acceleration(slots[k], s.background);
+        }
+    });
+    if (shadow) return;
+    updateEncounters(s);
+    gatherHeavyBodies();
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int k = 0; k < count; ++k) {
+        NoTraversalStats none;
+        if (!isDead(particles[slots[k]])) out[k] = accelerationOf(slots[k], s, none);
+    }
+}
+
+void SimulationEngine::queueToolEvent(const ToolEvent& e) {
+    if (e.tool == InteractionTool::None || e.radius <= 0.0f || pendingToolCount >= kMaxToolEvents) return;
+    pendingTools[pendingToolCount++] = e;
+}
+
+namespace {
+// A tool event in the simulation frame, with its share of the step
+struct ActiveTool {
+    InteractionTool tool;
+    glm::vec3 center;
+    float radius, r2;
+    float strength;
+};
+
+glm::vec3 toolForce(const ActiveTool& t, const Particle& p) {
+    glm::vec3 d = t.center - p.position;
+    float dist2 = glm::dot(d, d) + 1e-6f;
+    if (dist2 > t.r2) return glm::vec3(0.0f);
+    float dist = sqrtf(dist2);
+    glm::vec3 n = d / dist;
+    glm::vec3 f(0.0f);
+    switch (t.tool) {
+        case InteractionTool::Attract:
+            f = n * (t.strength * p.mass / dist2);
+            break;
+        case InteractionTool::Repel:
+            f = -n * (fabsf(t.strength) * p.mass / dist2);
+            break;
+        case InteractionTool::Drag: {
+            float springK = fabsf(t.strength);
+            glm::vec3 spring = springK * (t.center - p.position);
+            glm::vec3 damping = -0.5f * springK * p.velocity;
+            f = spring + damping;
+        } break;
+        default: break;
+    }
+    float fall = glm::clamp(1.0f - (dist / t.radius), 0.0f, 1.0f);
+    return f * (fall * fall);
+}
+
+// Attract/Repel force per unit mass at a point, used for whole far-away nodes
+glm::vec3 toolAccel(const ActiveTool& t, const glm::vec3& at) {
+    glm::vec3 d = t.center - at;
+    float dist2 = glm::dot(d, d) + 1e-6f;
+    float dist = sqrtf(dist2);
+    float k = (t.tool == InteractionTool::Attract) ? t.strength : -fabsf(t.strength);
+    float fall = glm::clamp(1.0f - (dist / t.radius), 0.0f, 1.0f);
+    return (d / dist) * (k / dist2) * (fall * fall);
+}
+} // namespace
+
+// One tree traversal for every pending tool: nodes outside all spheres are
+// skipped, nodes inside a sphere stop being tested against it, and
+// Attract/Repel spheres treat nodes that are inside and small as seen from
+// the tool (size / distance < theta) as a uniform field sampled at their
+// centre of mass. The selected ranges are disjoint, so they run in parallel.
+// Tools act as a velocity kick of one step ahead of the force pass.
+void SimulationEngine::applyTools(const SimulationSettings& s) {
+    ActiveTool tools[kMaxToolEvents];
+    int count = 0;
+    if (pendingToolCount == 0) {
+        ToolEvent e; e.tool = s.tool; e.center = s.toolWorld; e.radius = s.toolRadius; e.strength = s.toolStrength;
+        queueToolEvent(e);
+    }
+    for (int i = 0; i < pendingToolCount; ++i) {
+        const ToolEvent& e = pendingTools[i];
+        tools[count++] = { e.tool, toSimFrame(e.center), e.radius, e.radius * e.radius, e.strength / pendingToolCount };
+    }
+    pendingToolCount = 0;
+
+    const uint32_t all = (count >= 32) ? ~0u : ((1u << count) - 1u);
+    toolWork.clear();
+    const OctreeNode* root = bh.getRoot();
+    if (!treeCurrent || !root) {
+        // stale bounds: exact pass over everything, in particle order
+        const int kChunk = 4096;
+        for (int first = 0; first < (int)particles.size(); first += kChunk) {
+            toolWork.push_back({ first, std::min(kChunk, (int)particles.size() - first), all, glm::vec3(0.0f) });
+        }
+    } else {
+        struct Item { const OctreeNode* node; uint32_t partial, inside; glm::vec3 farAccel; };
+        Item stack[BarnesHut::kStackSize];
+        int top = 0;
+        stack[top++] = { root, all, 0u, glm::vec3(0.0f) };
+        while (top > 0) {
+            Item it = stack[--top];
+            const OctreeNode* node = it.node;
+            const AABB& box = node->box;
+            const float size = 2.0f * std::max(std::max(box.halfSize.x, box.halfSize.y), box.halfSize.z);
+            uint32_t partial = 0, inside = it.inside;
+            for (int t = 0; t < count; ++t) {
+                if (!(it.partial & (1u << t))) continue;
+                const ActiveTool& tool = tools[t];
+                glm::vec3 d = glm::abs(tool.center - box.center);
+                glm::vec3 gap = glm::max(d - box.halfSize, glm::vec3(0.0f));
+                if (glm::dot(gap, gap) > tool.r2) continue; // disjoint
+                glm::vec3 far = d + box.halfSize;
+                if (glm::dot(far, far) > tool.r2) { partial |= 1u << t; continue; }
+                bool field = tool.tool == InteractionTool::Attract || tool.tool == InteractionTool::Repel;
+                if (field && size < s.theta * glm::length(tool.center - node->com)) it.farAccel += toolAccel(tool, node->com);
+                else inside |= 1u << t;
+            }
+            if (partial && !node->isLeaf()) {
+                for (const OctreeNode* c : node->children) if (c) stack[top++] = { c, partial, inside, it.farAccel };
+            } else if ((partial | inside) != 0 || it.farAccel != glm::vec3(0.0f)) {
+                toolWork.push_back({ node->first, node->count, partial | inside, it.farAccel });
+            }
+        }
+        // tracers and heavy bodies are not in the tree: exact pass over their ranges
+        const int kChunk = 4096;
+        for (int first = bh.treeCount(); first < bh.builtCount(); first += kChunk) {
+            toolWork.push_back({ first, std::min(kChunk, bh.builtCount() - first), all, glm::vec3(0.0f) });
+        }
+    }
+
+    const int* order = (treeCurrent && root) ? bh.particleOrder() : nullptr;
+    const float dt = s.timeStep;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int w = 0; w < (int)toolWork.size(); ++w) {
+        const ToolWork& work = toolWork[w];
+        for (int k = work.first; k < work.first + work.count; ++k) {
+            Particle& p = particles[order ? order[k] : k];
+            if (p.mass <= 0.0f) continue; // tombstones
+            glm::vec3 f(0.0f);
+            for (int t = 0; t < count; ++t) if (work.exact & (1u << t)) f += toolForce(tools[t], p);
+            p.velocity += (work.farAccel + f / p.mass) * dt;
+        }
+    }
+}
+
+void SimulationEngine::requestPick(const glm::vec3& origin, const glm::vec3& dir, float radius) {
+    pickRequested = true;
+    pickOrigin = origin;
+    pickDir = dir;
+    pickRadius = radius;
+}
+
+void SimulationEngine::updatePick(const SimulationSettings& s) {
+    if (pickRequested) {
+        pickRequested = false;
+        // bounds the cost of a ray grazing a dense disk at large N
+        const int kNodeBudget = 4096;
+        glm::vec3 origin = toSimFrame(pickOrigin), dir = glm::normalize(toSimFrame(pickDir));
+        pickInfo = PickInfo{};
+        int hit = -1;
+        if (treeCurrent) {
+            hit = bh.raycast(particles, origin, dir, pickRadius, maxParticleRadius, kNodeBudget);
+        } else {
+            // stale bounds: exact scan (picks are rare)
+            float bestT = INFINITY;
+            for (int j = 0; j < (int)particles.size(); ++j) {
+                float t = particleRayHit(particles[j], origin, dir, pickRadius);
+                if (t >= 0.0f && t < bestT) { bestT = t; hit = j; }
+            }
         }
+        if (hit >= 0) pickInfo.id = store.idOf(hit);
+    }
+    // the ID outlives slot changes; a stale one means the particle was absorbed
+    const int i = store.slotOf(pickInfo.id);
+    if (i < 0) { pickInfo = PickInfo{}; return; }
+    const Particle& p = particles[i];
+    pickInfo.index = i;
+    pickInfo.position = p.position;
+    pickInfo.velocity = p.velocity;
+    pickInfo.mass = p.mass;
+    pickInfo.radius = p.radius;
+    pickInfo.neighbours = 0;
+    pickInfo.nearest = kInvalidParticleId;
+    int nearest = -1;
+    float nearest2 = INFINITY;
+    auto neighbour = [&](int j) {
+        if (j == i || isDead(particles[j])) return;
+        ++pickInfo.neighbours;
+        glm::vec3 d = particles[j].position - p.position;
+        float d2 = glm::dot(d, d);
+        if (d2 < nearest2) { nearest2 = d2; nearest = j; }
     };
-    struct KeyEq { bool operator()(const CellKey& a, const CellKey& b) const noexcept { return a.x==b.x && a.y==b.y && a.z==b.z; } };
+    if (treeCurrent) {
+        bh.forEachInSphere(particles, p.position, s.inspectRadius, neighbour);
+    } else {
+        // stale bounds: exact scan, as for the horizon
+        const float r2 = s.inspectRadius * s.inspectRadius;
+        for (int j = 0; j < (int)particles.size(); ++j) {
+            if (glm::distance2(particles[j].position, p.position) <= r2) neighbour(j);
+        }
+    }
+    if (nearest >= 0) pickInfo.nearest = store.idOf(nearest);
+    pickInfo.nearestDist = (nearest >= 0) ? sqrtf(nearest2) : 0.0f;
+}
+
+// Each pair moves as its centre of mass under the global step; the relative
+// orbit is advanced in regularized time, perturbed by the tidal difference of
+// the external accelerations (each leaves its partner out, see gatherHeavyBodies).
+// Pairs with an absorbed member were dropped by updateEncounters.
+void SimulationEngine::integrateEncounters(const SimulationSettings& s) {
+    const int kMaxSubsteps = 100000;
+    const float dt = s.timeStep;
+    const bool relative = s.openingCriterion == OpeningCriterion::RelativeAcceleration;
+    for (const Encounter& e : encounters) {
+        Particle& a = particles[e.slotA];
+        Particle& b = particles[e.slotB];
+        NoTraversalStats none;
+        const glm::vec3 accelA = accelerationOf(e.slotA, s, none), accelB = accelerationOf(e.slotB, s, none);
+        if (relative) {
+            lastAccel[e.slotA] = glm::length(accelA);
+            lastAccel[e.slotB] = glm::length(accelB);
+        }
+        const float m = a.mass + b.mass;
+        glm::vec3 com = (a.mass * a.position + b.mass * b.position) / m;
+        glm::vec3 vcom = (a.mass * a.velocity + b.mass * b.velocity) / m;
+        vcom += (a.mass * accelA + b.mass * accelB) / m * dt;
+        vcom *= (1.0f - s.damping);
+        com += vcom * dt;
+        glm::vec3 r = b.position - a.position;
+        glm::vec3 v = b.velocity - a.velocity;
+        profile.encounterSubsteps += advanceRegularizedPair(r, v, s.gravityG * m, accelB - accelA, dt,
+                                                            s.encounterStepsPerOrbit, kMaxSubsteps);
+        a.position = com - (b.mass / m) * r;
+        b.position = com + (a.mass / m) * r;
+        a.velocity = vcom - (b.mass / m) * v;
+        b.velocity = vcom + (a.mass / m) * v;
+        if (periodicBox > 0.0f) {
+            a.position = wrapPeriodic(a.position, periodicBox);
+            b.position = wrapPeriodic(b.position, periodicBox);
+        }
+    }
+    profile.encounters = (int)encounters.size();
+}
 
+void SimulationEngine::handleCollisions(float restitution) {
     if (particles.empty()) return;
     // Choose cell size ~ 2x typical radius
     float avgR = 0.0f; int sampleN = (int)std::min<size_t>(particles.size(), 256);
-    for (int i = 0; i < sampleN; ++i) avgR += particles[i].radius;
+    for (int i = 0; i < sampleN; ++i) avgR += std::max(0.0f, particles[i].radius);
     avgR = (sampleN > 0) ? (avgR / sampleN) : 1.0f;
     const float cellSize = std::max(0.5f, avgR * 2.5f);
     const float invCell = 1.0f / cellSize;
 
-    std::unordered_map<CellKey, std::vector<int>, KeyHash, KeyEq> grid;
-    grid.reserve(particles.size()*2);
-
-    auto cellOf = [&](const glm::vec3& p){
-        return CellKey{ (int)floorf(p.x * invCell), (int)floorf(p.y * invCell), (int)floorf(p.z * invCell) };
+    // Pack 3 x 21-bit cell coordinates into a sortable key (z most significant)
+    const int kBias = 1 << 20;
+    auto coord = [&](float v) {
+        int c = (int)floorf(v * invCell);
+        return (uint64_t)(std::clamp(c, -kBias + 1, kBias - 2) + kBias);
     };
 
-    // Build grid
+    // Build grid: sorted (key, index) pairs; the buffer keeps its capacity across frames
+    collisionCells.resize(particles.size());
+    #pragma omp parallel for schedule(static)
     for (int i = 0; i < (int)particles.size(); ++i) {
-        CellKey key = cellOf(particles[i].position);
-        grid[key].push_back(i);
-    }
-
-    // Neighbor offsets (27 cells)
-    int offs[27][3]; int t=0; for(int dz=-1; dz<=1; ++dz) for(int dy=-1; dy<=1; ++dy) for(int dx=-1; dx<=1; ++dx){ offs[t][0]=dx; offs[t][1]=dy; offs[t][2]=dz; ++t; }
-
-    // Resolve collisions
-    for (const auto& kv : grid) {
-        const CellKey& c = kv.first;
-        for (int nbi = 0; nbi < 27; ++nbi) {
-            CellKey nb{ c.x + offs[nbi][0], c.y + offs[nbi][1], c.z + offs[nbi][2] };
-            auto it = grid.find(nb);
-            if (it == grid.end()) continue;
-            const auto& a = kv.second;
-            const auto& b = it->second;
-            for (int ii = 0; ii < (int)a.size(); ++ii) {
-                int i = a[ii];
-                int jjStart = (&a == &b) ? (ii+1) : 0;
-                for (int jj = jjStart; jj < (int)b.size(); ++jj) {
-                    int j = b[jj];
-                    glm::vec3 r = particles[j].position - particles[i].position;
-                    float minDist = particles[i].radius + particles[j].radius;
-                    float dist2 = glm::dot(r,r);
-                    if (dist2 < minDist * minDist) {
-                        float dist = sqrtf(std::max(dist2, 1e-12f));
-                        glm::vec3 n = (dist > 0.0f) ? (r / dist) : glm::vec3(1,0,0);
-                        float mi = particles[i].mass, mj = particles[j].mass;
-                        glm::vec3 vi = particles[i].velocity;
-                        glm::vec3 vj = particles[j].velocity;
-                        float vi_n = glm::dot(vi, n);
-                        float vj_n = glm::dot(vj, n);
-                        float pi = (2.0f * (vi_n - vj_n)) / (mi + mj);
-                        particles[i].velocity = vi - pi * mj * n * restitution;
-                        particles[j].velocity = vj + pi * mi * n * restitution;
-                        float overlap = minDist - dist;
-                        particles[i].position -= n * (overlap * (mj / (mi + mj)));
-                        particles[j].position += n * (overlap * (mi / (mi + mj)));
-                    }
-                }
-            }
+        const glm::vec3& p = particles[i].position;
+        collisionCells[i] = { coord(p.x) | (coord(p.y) << 21) | (coord(p.z) << 42), i };
+    }
+    std::sort(collisionCells.begin(), collisionCells.end(), [](const CellEntry& a, const CellEntry& b) {
+        return a.key < b.key || (a.key == b.key && a.index < b.index);
+    });
+
+    auto resolve = [&](int i, int j) {
+        if (isDead(particles[i]) || isDead(particles[j]) || isTracer(particles[i]) || isTracer(particles[j])) return;
+        if ((particles[i].flags & particles[j].flags) & kParticleRegularized) return; // the pair integrator owns it
+        glm::vec3 r = particles[j].position - particles[i].position;
+        float minDist = particles[i].radius + particles[j].radius;
+        float dist2 = glm::dot(r,r);
+        if (dist2 < minDist * minDist) {
+            float dist = sqrtf(std::max(dist2, 1e-12f));
+            glm::vec3 n = (dist > 0.0f) ? (r / dist) : glm::vec3(1,0,0);
+            float mi = particles[i].mass, mj = particles[j].mass;
+            glm::vec3 vi = particles[i].velocity;
+            glm::vec3 vj = particles[j].velocity;
+            float vi_n = glm::dot(vi, n);
+            float vj_n = glm::dot(vj, n);
+            float pi = (2.0f * (vi_n - vj_n)) / (mi + mj);
+            particles[i].velocity = vi - pi * mj * n * restitution;
+            particles[j].velocity = vj + pi * mi * n * restitution;
+            float overlap = minDist - dist;
+            particles[i].position -= n * (overlap * (mj / (mi + mj)));
+            particles[j].position += n * (overlap * (mi / (mi + mj)));
+        }
+    };
+
+    // Spheres in sorted order for SimdKernels::overlaps; candidates are
+    // found on these positions and resolve re-tests the live ones
+    const int n = (int)collisionCells.size();
+    CollisionSpheres& sp = collisionSpheres;
+    sp.x.resize(n); sp.y.resize(n); sp.z.resize(n); sp.r.resize(n); sp.hits.resize(n);
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < n; ++k) {
+        const Particle& p = particles[collisionCells[k].index];
+        sp.x[k] = p.position.x; sp.y[k] = p.position.y; sp.z[k] = p.position.z; sp.r[k] = p.radius;
+    }
+    const SimdKernels& simd = simdKernels();
+    auto test = [&](int ii, int first, int last) {
+        const int hits = simd.overlaps(sp.x.data(), sp.y.data(), sp.z.data(), sp.r.data(), ii, first, last, sp.hits.data());
+        for (int h = 0; h < hits; ++h) resolve(collisionCells[ii].index, collisionCells[sp.hits[h]].index);
+    };
+    auto lowerBound = [&](int from, uint64_t key) {
+        auto it = std::lower_bound(collisionCells.begin() + from, collisionCells.end(), key,
+                                   [](const CellEntry& e, uint64_t k) { return e.key < k; });
+        return (int)(it - collisionCells.begin());
+    };
+
+    // Half stencil: the 13 neighbours whose key is larger than the cell's own,
+    // so every pair of cells is visited exactly once. Keys along x are
+    // consecutive, so they form five contiguous runs of the sorted array: the
+    // cell with its +x neighbour, and the rows of three at (dy, dz) = (1, 0),
+    // (-1, 1), (0, 1) and (1, 1).
+    const int64_t rows[4] = { (int64_t)1 << 21, ((int64_t)1 << 42) - ((int64_t)1 << 21), (int64_t)1 << 42,
+                              ((int64_t)1 << 42) + ((int64_t)1 << 21) };
+    for (int a0 = 0; a0 < n;) {
+        const uint64_t key = collisionCells[a0].key;
+        int a1 = a0;
+        while (a1 < n && collisionCells[a1].key == key) ++a1;
+        const int x1 = lowerBound(a1, key + 2);
+        for (int ii = a0; ii < a1; ++ii) test(ii, ii + 1, x1);
+        int from = x1;
+        for (int64_t row : rows) {
+            const int b0 = lowerBound(from, key + row - 1), b1 = lowerBound(b0, key + row + 2);
+            for (int ii = a0; ii < a1 && b0 < b1; ++ii) test(ii, b0, b1);
+            from = b1;
         }
+        a0 = a1;
     }
 }
 
-void SimulationEngine::initGalaxy(int n) {
+void SimulationEngine::initGalaxy(int n, float tracerFraction) {
     particles.resize(n);
     std::uniform_real_distribution<float> uni(0.0f, 1.0f);
     float R = 500.0f;
+    // every k-th disk particle stays massive and carries the mass of the tracers it stands for
+    const float f = glm::clamp(tracerFraction, 0.0f, 0.999f);
+    const int sourceEvery = std::max(1, (int)lroundf(1.0f / (1.0f - f)));
     for (int i = 0; i < n; ++i) {
         float r = R * sqrtf(uni(rng));
         float theta = 2.0f * glm::pi<float>() * uni(rng);
@@ -189,6 +802,10 @@ void SimulationEngine::initGalaxy(int n) {
         particles[i].mass = 1.0f;
         particles[i].radius = 0.5f;
         particles[i].color = glm::vec4(0.7f + 0.3f * uni(rng), 0.7f, 1.0f, 1.0f);
+        if (sourceEvery > 1) {
+            if (i % sourceEvery == 0) particles[i].mass = (float)sourceEvery;
+            else particles[i].flags = kParticleTracer;
+        }
     }
     // central massive body
     particles[0].mass = 100000.0f;
@@ -196,6 +813,7 @@ void SimulationEngine::initGalaxy(int n) {
     particles[0].position = glm::vec3(0);
     particles[0].velocity = glm::vec3(0);
     particles[0].color = glm::vec4(5.0f, 4.0f, 2.0f, 1.0f);
+    particles[0].flags = kParticleHeavy;
 }
 
 void SimulationEngine::initBlackHole(int n) {
@@ -233,27 +851,63 @@ void SimulationEngine::initBlackHole(int n) {
         particles[0].position = glm::vec3(0);
         particles[0].velocity = glm::vec3(0);
         particles[0].color = glm::vec4(10.0f, 8.0f, 6.0f, 1.0f);
+        particles[0].flags = kParticleHeavy;
     }
 }
 
+// Particles inside the horizon are found with a range query on the current
+// tree and marked dead in place; the hole takes their mass and momentum.
+// Dead particles are masked everywhere (massless, frozen, skipped by forces
+// and collisions), so the tree stays valid and is reused until compaction.
+// Its moments still hold the absorbed mass until the next build or refit.
 void SimulationEngine::applyBlackHoleEventHorizon() {
     if (particles.empty()) return;
-    const Particle& bhole = particles[0];
-    const float horizon = bhole.radius * 1.2f;
-    particles.erase(std::remove_if(particles.begin()+1, particles.end(), [&](const Particle& p){
-        return glm::length(p.position - bhole.position) < horizon;
-    }), particles.end());
+    Particle& hole = particles[0];
+    const float horizon = hole.radius * 1.2f;
+    const glm::vec3 center = hole.position;
+    float absorbedMass = 0.0f;
+    glm::vec3 absorbedMomentum(0.0f);
+    auto absorb = [&](int i) {
+        Particle& p = particles[i];
+        if (i == 0 || isDead(p)) return;
+        absorbedMass += p.mass;
+        absorbedMomentum += p.mass * p.velocity;
+        store.kill(i);
+    };
+    if (treeCurrent) {
+        bh.forEachInSphere(particles, center, horizon, absorb);
+    } else {
+        const float h2 = horizon * horizon;
+        for (int i = 1; i < (int)particles.size(); ++i) {
+            if (glm::distance2(particles[i].position, center) < h2) absorb(i);
+        }
+    }
+    if (absorbedMass > 0.0f) {
+        float m = hole.mass + absorbedMass;
+        hole.velocity = (hole.mass * hole.velocity + absorbedMomentum) / m;
+        hole.mass = m;
+    }
 }
 
-void SimulationEngine::rotateAll(float radians) {
-    float c = cosf(radians), s = sinf(radians);
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < (int)particles.size(); ++i) {
-        glm::vec3 p = particles[i].position;
-        particles[i].position = glm::vec3(c*p.x + s*p.z, p.y, -s*p.x + c*p.z);
-        glm::vec3 v = particles[i].velocity;
-        particles[i].velocity = glm::vec3(c*v.x + s*v.z, v.y, -s*v.x + c*v.z);
-    }
+// Drops the tombstones; per-slot state kept here follows the store's order-preserving compaction
+void SimulationEngine::compactDead() {
+    int out = 0;
+    for (int i = 0; i < (int)lastAccel.size(); ++i) if (!isDead(particles[i])) lastAccel[out++] = lastAccel[i];
+    lastAccel.resize(out);
+    store.compact();
+}
+
+ParticleId SimulationEngine::spawnParticle(const Particle& p) {
+    ParticleId id = store.spawn(p);
+    if (id == kInvalidParticleId) return id;
+    maxParticleRadius = std::max(maxParticleRadius, p.radius);
+    const int slot = store.slotOf(id);
+    if (slot < (int)lastAccel.size()) lastAccel[slot] = 0.0f;
+    return id;
+}
+
+void SimulationEngine::rotateWorldFrame(float radians) {
+    worldFrame = glm::normalize(glm::angleAxis(radians, glm::vec3(0.0f, 1.0f, 0.0f)) * worldFrame);
 }
 
 void SimulationEngine::initSupernova(int n) {
@@ -278,6 +932,20 @@ void SimulationEngine::initInteractions(int n) {
         particles[i].velocity = glm::vec3(0.0f);
         particles[i].mass = 1.0f;
         particles[i].radius = 1.0f;
-        particles[i].color = glm::vec4(0.8f, 0.9f, 1.0f, 1.0f);
+        // charged dust, neutral overall; only felt with coulombK set
+        particles[i].charge = (i & 1) ? 1.0f : -1.0f;
+        particles[i].color = (i & 1) ? glm::vec4(1.0f, 0.85f, 0.8f, 1.0f) : glm::vec4(0.8f, 0.9f, 1.0f, 1.0f);
+    }
+}
+
+void SimulationEngine::initUniformBox(int n, float boxSize) {
+    particles.resize(n);
+    std::uniform_real_distribution<float> uni(-0.5f, 0.5f);
+    for (int i = 0; i < n; ++i) {
+        particles[i].position = glm::vec3(uni(rng), uni(rng), uni(rng)) * boxSize;
+        particles[i].velocity = glm::vec3(uni(rng), uni(rng), uni(rng)) * 2.0f;
+        particles[i].mass = 1.0f;
+        particles[i].radius = 0.5f;
+        particles[i].color = glm::vec4(0.75f, 0.8f, 1.0f, 1.0f);
     }
 }
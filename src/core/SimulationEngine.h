@@ -1,15 +1,35 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <random>
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include "Particle.h"
+#include "ParticleStore.h"
 #include "BarnesHut.h"
+#include "BackgroundPotential.h"
+#include "ParticleMesh.h"
+#include "ShadowSystem.h"
+#include "FrameProfile.h"
+#include "SolverProfile.h"
 
 enum class SimulationModule {
     Galaxy,
     BlackHole,
     Supernova,
-    Interactions
+    Interactions,
+    UniformBox // uniform periodic cube of side boxSize, for the mesh solvers
+};
+
+enum class GravitySolver {
+    Tree,   // Barnes-Hut, open boundaries
+    TreePM, // periodic: mesh long range + erfc-truncated tree short range
+    PM      // periodic: mesh only, resolution of one cell (fast preview)
+};
+
+enum class ScalarPrecision {
+    Single, // float: the particles themselves
+    Double  // gravity and integration on a double shadow of the state
 };
 
 enum class InteractionTool {
@@ -19,50 +39,226 @@ enum class InteractionTool {
     Drag
 };
 
+// One application of an interaction tool; center is in world space
+struct ToolEvent {
+    InteractionTool tool = InteractionTool::None;
+    glm::vec3 center{0.0f};
+    float radius = 0.0f;
+    float strength = 0.0f;
+};
+
+// Inspector data for the picked particle, refreshed every step (simulation frame)
+struct PickInfo {
+    ParticleId id = kInvalidParticleId; // followed across absorption, spawning and compaction
+    int index = -1; // slot this step, -1 = nothing picked
+    glm::vec3 position{0.0f};
+    glm::vec3 velocity{0.0f};
+    float mass = 0.0f;
+    float radius = 0.0f;
+    int neighbours = 0; // within SimulationSettings::inspectRadius
+    ParticleId nearest = kInvalidParticleId;
+    float nearestDist = 0.0f;
+};
+
 struct SimulationSettings {
     SimulationModule module = SimulationModule::Galaxy;
     int particleCount = 100000; // start with 100k; scalable
+    float tracerFraction = 0.0f; // Galaxy: share of disk particles that only trace the potential (applied on reset)
     float timeStep = 0.005f;
     float damping = 0.0f;
     float gravityG = 1.0f;
     float softening = 0.01f;
     float theta = 0.7f;
+    // Force walk policies (see ForcePolicies.h); accelTolerance is the alpha of
+    // the relative-acceleration criterion, which ignores theta after the first step
+    SofteningKernel softeningKernel = SofteningKernel::Plummer;
+    OpeningCriterion openingCriterion = OpeningCriterion::Geometric;
+    float accelTolerance = 0.0025f;
+    // TreePM and PM make space a periodic cube of side boxSize centred on the origin
+    GravitySolver gravitySolver = GravitySolver::Tree;
+    float boxSize = 1000.0f;
+    int pmGrid = 64;            // mesh cells per side, rounded up to a power of two
+    float pmSplitCells = 1.25f; // TreePM split scale r_s in mesh cells
+    // Gravity and integration in double precision and/or confined to the x-z plane
+    // (quadtree). Anything but Single in 3D runs on a ShadowSystem copy of the
+    // state, with open boundaries and without regularized encounters.
+    ScalarPrecision precision = ScalarPrecision::Single;
+    int dimensions = 3; // 3, or 2
+    float coulombK = 0.0f; // electrostatics between Particle::charge, 0 = off (heavy bodies and tracers carry none)
+    BackgroundPotential background; // analytic field added in the force pass
     bool collisions = false;
+    int collisionEveryN = 1; // resolve collisions every N steps
     float restitution = 1.0f; // 1 elastic, <1 inelastic
+    float compactDeadFraction = 0.05f; // compact absorbed particles once they exceed this fraction
+    // Close encounters: bound heavy pairs closer than this are integrated apart in
+    // regularized time with their own sub-steps; 0 = off
+    float encounterRadius = 0.0f;
+    int encounterStepsPerOrbit = 64;
     int rebuildEveryN = 1; // build Barnes-Hut tree every N frames (1 = every frame)
+    bool refitBetweenBuilds = true; // otherwise skipped frames reuse stale moments
+    // Interaction lists per group of at most this many particles, kept across
+    // refits (BarnesHutParams::listGroupSize); 0 = a walk per particle
+    int interactionListGroup = 0;
+    // Builds the next step's tree from predicted positions on one thread while
+    // the others run the force pass; that step then only refits it. Float 3D,
+    // steps due for a rebuild, two or more threads.
+    bool pipelineBuild = false;
+    // Pacing (threaded simulation): fixed steps per wall second, 0 = as fast as possible
+    float simRate = 60.0f;
+    int maxStepsPerTick = 4; // step budget when behind; excess simulated time is dropped
     // Interactive tools
     InteractionTool tool = InteractionTool::None;
     glm::vec3 toolWorld{0.0f};
     float toolRadius = 50.0f;
     float toolStrength = 1000.0f; // positive attracts, negative repels
     bool toolEngaged = false; // set true while mouse is held down
+    float inspectRadius = 5.0f; // neighbourhood shown for the picked particle
+    // Memory (applied on reset)
+    HugePageMode hugePages = HugePageMode::Transparent;
+    // Profiling: hardware counters around each phase of update() (Linux perf_event)
+    bool hardwareCounters = false;
+    bool hardwareCountersPerThread = true;
+    // Tree shape and traversal counters (per-thread, merged after the force pass)
+    bool treeStats = false;
 };
 
 class SimulationEngine {
 public:
     SimulationEngine();
+    // particles aliases the store's array
+    SimulationEngine(const SimulationEngine&) = delete;
+    SimulationEngine& operator=(const SimulationEngine&) = delete;
     void reset(const SimulationSettings& settings);
     void update(const SimulationSettings& settings);
 
-    const std::vector<Particle>& getParticles() const { return particles; }
-    std::vector<Particle>& getParticlesMutable() { return particles; }
-    void rotateAll(float radians);
+    // May contain dead (absorbed) particles until the next compaction; see isDead
+    const ParticleArray& getParticles() const { return particles; }
+    size_t getLiveCount() const { return store.liveCount(); }
+    ParticleArray& getParticlesMutable() { return particles; }
+    // Stable IDs of the slots in getParticles(); layoutVersion changes when a slot changes owner
+    const ParticleStore& getStore() const { return store; }
+    // Adds a particle between steps (into a dead slot when one is free); position and velocity in the simulation frame
+    // Returns kInvalidParticleId, adding nothing, when the store has no free ID left
+    ParticleId spawnParticle(const Particle& p);
+    // The simulation runs in its own frame; worldFrame maps it to world space.
+    // Rotating composes the quaternion only (O(1)): renderers apply it in the
+    // view matrix and world-space inputs such as the tool go through toSimFrame.
+    void rotateWorldFrame(float radians); // about the world Y axis
+    const glm::quat& getWorldFrame() const { return worldFrame; }
+    // Side of the periodic cube positions are wrapped into, 0 = open boundaries
+    float getPeriodicBox() const { return periodicBox; }
+    glm::vec3 toSimFrame(const glm::vec3& world) const { return glm::inverse(worldFrame) * world; }
+    // Tool events gathered between two steps and applied together by the next
+    // update, each with 1/count of its strength; without queued events an
+    // engaged settings tool is applied. Events past kMaxToolEvents are dropped.
+    static constexpr int kMaxToolEvents = 32;
+    void queueToolEvent(const ToolEvent& e);
+    // Picking: the ray (world space) is cast against the tree of the next
+    // step, or every particle while that tree is stale; the hit is then
+    // followed across steps until cleared or absorbed
+    void requestPick(const glm::vec3& origin, const glm::vec3& dir, float pickRadius);
+    void clearPick() { pickRequested = false; pickInfo = PickInfo{}; }
+    const PickInfo& getPickInfo() const { return pickInfo; }
+    // Sampled NUMA placement of the particle array, refreshed on reset
+    const PagePlacementReport& getPagePlacement() const { return pagePlacement; }
+    // Per-phase wall time (and hardware counters if enabled) of the last update
+    const FrameProfile& getProfile() const { return profile; }
+    const PerfCounters& getPerfCounters() const { return perf; }
+    // Valid while SimulationSettings::treeStats is on
+    const TreeStats& getTreeStats() const { return treeStats; }
+    // Loaded from SolverProfile::kDefaultPath on construction; takes effect on the next update
+    const SolverProfile& getSolverProfile() const { return solver; }
+    bool solverProfileLoaded() const { return solverLoaded; }
+    // Chunk of the force loops in particles, 0 for a static schedule
+    int forceChunk() const { return numaSpread ? 0 : solver.forceChunk; }
+    void setSolverProfile(const SolverProfile& p) { solver = p; }
+    // Acceleration of each slot in slots at the current positions, tools
+    // aside (zero for tombstones); rebuilds the tree, for force checks between steps
+    void sampleAccelerations(const SimulationSettings& settings, const std::vector<int>& slots, std::vector<glm::vec3>& out);
 
 private:
-    std::vector<Particle> particles;
+    ParticleStore store;
+    ParticleArray& particles = store.data();
     BarnesHut bh;
+    // SimulationSettings::pipelineBuild: built during the force pass at
+    // predicted (position + velocity dt of every slot), swapped with bh by the
+    // next update if no slot changed owner in between
+    BarnesHut bhNext;
+    std::vector<glm::vec3> predicted;
+    bool nextTreeReady = false;
+    uint64_t nextTreeLayout = 0;
+    // double and 2D gravity (SimulationSettings::precision, dimensions); the tree
+    // over the float particles still serves picking, tools and absorption
+    ShadowSystem<double, 3> shadowD3;
+    ShadowSystem<float, 2> shadowF2;
+    ShadowSystem<double, 2> shadowD2;
+    ParticleMesh pm;
+    std::vector<glm::vec3> meshAccel;
+    std::vector<float> lastAccel; // |a| of the previous step per slot, for the relative opening criterion
+    float periodicBox = 0.0f;
     std::mt19937 rng;
+    glm::quat worldFrame{1.0f, 0.0f, 0.0f, 0.0f};
     // performance controls
     int frameCounter = 0;
     size_t lastParticleCount = 0;
     BarnesHutParams lastBhParams{};
+    SolverProfile solver;
+    PagePlacementReport pagePlacement;
+    bool solverLoaded = false;
+    // particle pages sampled on more than one node: force loops keep the
+    // static partition of the first touch instead of balancing dynamically
+    bool numaSpread = false;
+    FrameProfile profile;
+    TreeStats treeStats;
+    PerfCounters perf;
+    bool perfRequested = false;
+    bool perfPerThread = false;
+    class PhaseScope;
+    // collision broad phase: (cell key, particle) pairs, reused across frames
+    struct CellEntry { uint64_t key; int index; };
+    std::vector<CellEntry> collisionCells;
+    struct CollisionSpheres { std::vector<float> x, y, z, r; std::vector<int> hits; };
+    CollisionSpheres collisionSpheres; // per sorted entry, and the overlap test's output
+    // interactive tools: pending events and the ranges a traversal selected
+    ToolEvent pendingTools[kMaxToolEvents];
+    int pendingToolCount = 0;
+    bool treeCurrent = false; // tree bounds match the positions of this step
+    struct ToolWork { int first, count; uint32_t exact; glm::vec3 farAccel; };
+    std::vector<ToolWork> toolWork;
+    // heavy bodies (isHeavy): slots refreshed when the layout changes, positions
+    // and masses gathered into arrays before each force pass; a regularized
+    // pair enters as one body at its centre of mass, owned by both slots
+    std::vector<int> heavySlots;
+    uint64_t heavyLayout = ~0ull;
+    std::vector<glm::vec3> heavyPos;
+    std::vector<float> heavyMass;
+    std::vector<glm::ivec2> heavyOwners;
+    struct Encounter { ParticleId a, b; int slotA, slotB; };
+    std::vector<Encounter> encounters;
+    // picking
+    bool pickRequested = false;
+    glm::vec3 pickOrigin{0.0f}, pickDir{0.0f, 0.0f, -1.0f};
+    float pickRadius = 0.0f;
+    float maxParticleRadius = 0.0f; // radii are fixed after init
+    PickInfo pickInfo;
 
-    void initGalaxy(int n);
+    BarnesHutParams treeParams(const SimulationSettings& s) const;
+    template <typename F> bool withShadow(const SimulationSettings& s, F&& f);
+    void initGalaxy(int n, float tracerFraction);
     void initBlackHole(int n);
     void initSupernova(int n);
     void initInteractions(int n);
-    void integrate(const SimulationSettings& settings);
+    void initUniformBox(int n, float boxSize);
+    void updateEncounters(const SimulationSettings& settings);
+    void gatherHeavyBodies();
+    void integrateEncounters(const SimulationSettings& settings);
+    glm::vec3 externalAccel(int i, const SimulationSettings& s) const;
+    template <typename Stats> glm::vec3 accelerationOf(int i, const SimulationSettings& s, Stats& stats) const;
+    bool pipelineBuild(const SimulationSettings& s) const;
+    template <typename Stats> void forceKickDrift(const SimulationSettings& s, Stats* stats, bool buildNext);
     void handleCollisions(float restitution);
     void applyBlackHoleEventHorizon();
-    void applyInteractiveTool(const SimulationSettings& settings);
+    void compactDead();
+    void applyTools(const SimulationSettings& settings);
+    void updatePick(const SimulationSettings& settings);
 };
@@ -0,0 +1,193 @@
+#include "SimulationThread.h"
+#include "AllocationTracker.h"
+#include <algorithm>
+#include <chrono>
+
+void SimulationThread::start(const SimulationSettings& settings) {
+    stop();
+    pendingSettings = settings;
+    settingsDirty = false; resetPending = false; pendingRotation = 0.0f;
+    running.store(true);
+    worker = std::thread(&SimulationThread::run, this, settings);
+}
+
+void SimulationThread::stop() {
+    running.store(false);
+    if (worker.joinable()) worker.join();
+}
+
+void SimulationThread::submitSettings(const SimulationSettings& settings) {
+    pendingSettings = settings;
+    settingsDirty = true;
+}
+
+void SimulationThread::requestReset(const SimulationSettings& settings) {
+    pendingSettings = settings;
+    resetPending = true;
+    pendingRotation = 0.0f;
+}
+
+void SimulationThread::pick(const glm::vec3& origin, const glm::vec3& dir, float pickRadius) {
+    pendingRayOrigin = origin;
+    pendingRayDir = dir;
+    pendingPickRadius = pickRadius;
+    pickPending = true;
+    clearPickPending = false;
+}
+
+void SimulationThread::flush() {
+    // A full queue just means the simulation is behind; keep the request and retry next frame
+    Command c;
+    if (resetPending) {
+        c.type = CommandType::Reset; c.settings = pendingSettings;
+        if (!commands.push(c)) return;
+        resetPending = false; settingsDirty = false;
+    }
+    if (settingsDirty) {
+        c.type = CommandType::Settings; c.settings = pendingSettings;
+        if (commands.push(c)) settingsDirty = false;
+    }
+    if (pendingRotation != 0.0f) {
+        c.type = CommandType::Rotate; c.radians = pendingRotation;
+        if (commands.push(c)) pendingRotation = 0.0f;
+    }
+    if (clearPickPending) {
+        c.type = CommandType::ClearPick;
+        if (commands.push(c)) clearPickPending = false;
+    }
+    if (pickPending) {
+        c.type = CommandType::Pick; c.rayOrigin = pendingRayOrigin; c.rayDir = pendingRayDir; c.pickRadius = pendingPickRadius;
+        if (commands.push(c)) pickPending = false;
+    }
+}
+
+static double steadySeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SimulationThread::run(SimulationSettings settings) {
+    // Reset on this thread so particle pages are first-touched by its OpenMP team
+    engine.reset(settings);
+    uint64_t step = 0;
+    double stepsPerSecond = 0.0;
+    double last = steadySeconds();
+    double lastStepped = last; // end of the previous batch of steps, for the rate
+    double accumulator = 0.0;
+
+    while (running.load(std::memory_order_relaxed)) {
+        Command c;
+        while (commands.pop(c)) {
+            switch (c.type) {
+                case CommandType::Settings:
+                    settings = c.settings;
+                    // every input frame's tool position reaches the next step
+                    if (settings.toolEngaged) {
+                        ToolEvent e; e.tool = settings.tool; e.center = settings.toolWorld;
+                        e.radius = settings.toolRadius; e.strength = settings.toolStrength;
+                        engine.queueToolEvent(e);
+                    }
+                    break;
+                case CommandType::Reset: settings = c.settings; engine.reset(settings); accumulator = 0.0; break;
+                case CommandType::Rotate: engine.rotateWorldFrame(c.radians); break;
+                case CommandType::Pick: engine.requestPick(c.rayOrigin, c.rayDir, c.pickRadius); break;
+                case CommandType::ClearPick: engine.clearPick(); break;
+            }
+        }
+
+        // Fixed-timestep accumulator: 0..maxStepsPerTick steps per tick
+        const double interval = (settings.simRate > 0.0f) ? 1.0 / settings.simRate : 0.0;
+        double now = steadySeconds();
+        double elapsed = now - last;
+        last = now; // each interval enters the accumulator once, sleeps included
+        int steps = 1;
+        if (interval > 0.0) {
+            accumulator += elapsed;
+            steps = (int)(accumulator / interval);
+            if (steps == 0) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(interval - accumulator));
+                continue;
+            }
+            const int budget = std::max(1, settings.maxStepsPerTick);
+            if (steps > budget) steps = budget; // too slow for real time: drop the debt
+            accumulator = std::min(accumulator - steps * interval, interval);
+        }
+
+        for (int k = 0; k < steps; ++k) {
+            if (k == steps - 1) capturePreviousPositions();
+            engine.update(settings);
+            ++step;
+        }
+
+        double inst = steps / (now - lastStepped + 1e-9);
+        lastStepped = now;
+        stepsPerSecond = (stepsPerSecond == 0.0) ? inst : (0.9 * stepsPerSecond + 0.1 * inst);
+        publish(step, stepsPerSecond, interval);
+    }
+}
+
+void SimulationThread::capturePreviousPositions() {
+    const ParticleArray& pts = engine.getParticles();
+    const std::vector<ParticleId>& ids = engine.getStore().ids();
+    prevPositions.resize(pts.size());
+    prevIds.resize(pts.size());
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < (int)pts.size(); ++i) { prevPositions[i] = pts[i].position; prevIds[i] = ids[i]; }
+    prevLayout = engine.getStore().layoutVersion();
+}
+
+void SimulationThread::publish(uint64_t step, double stepsPerSecond, double stepInterval) {
+    AllocationTracker::PhaseScope phase(FramePhase::Publish);
+    ParticleSnapshot& snap = snapshots.writeBuffer();
+    const ParticleArray& pts = engine.getParticles();
+    const ParticleStore& store = engine.getStore();
+    const std::vector<ParticleId>& ids = store.ids();
+    snap.particles.resize(pts.size());
+    const bool blend = stepInterval > 0.0 && !prevPositions.empty();
+    // spawns and compactions during the step moved particles between slots:
+    // match previous positions by ID; new particles start unblended
+    const bool remap = blend && store.layoutVersion() != prevLayout;
+    const float halfBox = 0.5f * engine.getPeriodicBox();
+    if (remap) {
+        prevSlotOfId.assign(store.idCapacity(), -1);
+        for (int k = 0; k < (int)prevIds.size(); ++k) {
+            if (prevIds[k] != kInvalidParticleId) prevSlotOfId[prevIds[k] & ParticleStore::kIndexMask] = k;
+        }
+    }
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < (int)pts.size(); ++i) {
+        RenderParticle& r = snap.particles[i];
+        r.position = pts[i].position;
+        r.radius = pts[i].radius;
+        r.color = isDead(pts[i]) ? glm::vec4(0.0f) : pts[i].color; // additive blending: invisible
+        r.velocity = pts[i].velocity;
+        r.id = ids[i];
+        int k = i;
+        if (remap) {
+            k = -1;
+            if (ids[i] != kInvalidParticleId) {
+                int c = prevSlotOfId[ids[i] & ParticleStore::kIndexMask];
+                if (c >= 0 && prevIds[c] == ids[i]) k = c;
+            }
+        }
+        r.prevPosition = (blend && k >= 0) ? prevPositions[k] : pts[i].position;
+        // wrapped across a periodic face: no sweep through the box
+        if (halfBox > 0.0f && glm::any(glm::greaterThan(glm::abs(r.position - r.prevPosition), glm::vec3(halfBox)))) r.prevPosition = r.position;
+        r.pad1 = 0.0f;
+    }
+    snap.liveParticles = engine.getLiveCount();
+    snap.step = step;
+    snap.stepsPerSecond = stepsPerSecond;
+    snap.worldFrame = engine.getWorldFrame();
+    snap.picked = engine.getPickInfo();
+    snap.publishTime = steadySeconds();
+    snap.stepInterval = blend ? stepInterval : 0.0;
+    snap.profile = engine.getProfile();
+    snap.treeStats = engine.getTreeStats();
+    snap.pagePlacement = engine.getPagePlacement();
+    snap.solver = engine.getSolverProfile();
+    snap.solverLoaded = engine.solverProfileLoaded();
+    snap.forceChunk = engine.forceChunk();
+    snap.perfAvailable = engine.getPerfCounters().available();
+    snap.perfStatus = engine.getPerfCounters().status();
+    snapshots.publish();
+}
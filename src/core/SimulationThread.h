@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include "SimulationEngine.h"
+#include "ParticleSnapshot.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+
+// Runs SimulationEngine on its own thread. Steps are published as immutable
+// snapshots through a lock-free triple buffer; settings, resets and frame
+// rotations, picks flow back through a lock-free command queue. The render thread
+// never waits for a step, and the simulation never waits for swap/present.
+// With SimulationSettings::simRate > 0 steps are paced by a fixed-timestep
+// accumulator and snapshots carry the previous positions for interpolation.
+class SimulationThread {
+public:
+    SimulationThread() = default;
+    ~SimulationThread() { stop(); }
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    void start(const SimulationSettings& settings);
+    void stop();
+
+    // Render-thread side. Requests are coalesced and sent by flush() once per frame.
+    void submitSettings(const SimulationSettings& settings);
+    void requestReset(const SimulationSettings& settings);
+    void rotate(float radians) { pendingRotation += radians; }
+    // World-space ray; the result shows up in ParticleSnapshot::picked
+    void pick(const glm::vec3& origin, const glm::vec3& dir, float pickRadius);
+    void clearPick() { pickPending = false; clearPickPending = true; }
+    void flush();
+
+    // Newest published snapshot (empty before the first step)
+    const ParticleSnapshot& latest() { snapshots.fetch(); return snapshots.readBuffer(); }
+
+private:
+    enum class CommandType { Settings, Reset, Rotate, Pick, ClearPick };
+    struct Command {
+        CommandType type = CommandType::Settings;
+        SimulationSettings settings;
+        float radians = 0.0f;
+        glm::vec3 rayOrigin{0.0f}, rayDir{0.0f};
+        float pickRadius = 0.0f;
+    };
+
+    SimulationEngine engine;
+    std::thread worker;
+    std::atomic<bool> running{false};
+    SpscQueue<Command, 64> commands;
+    TripleBuffer<ParticleSnapshot> snapshots;
+
+    // render-thread pending state
+    SimulationSettings pendingSettings;
+    bool settingsDirty = false;
+    bool resetPending = false;
+    float pendingRotation = 0.0f;
+    bool pickPending = false, clearPickPending = false;
+    glm::vec3 pendingRayOrigin{0.0f}, pendingRayDir{0.0f};
+    float pendingPickRadius = 0.0f;
+
+    void run(SimulationSettings settings);
+    // positions before the last step of a tick, with the IDs owning those slots
+    std::vector<glm::vec3> prevPositions;
+    std::vector<ParticleId> prevIds;
+    uint64_t prevLayout = 0;
+    std::vector<int> prevSlotOfId; // ID index -> slot in prevPositions, rebuilt when the layout changed
+
+    void capturePreviousPositions();
+    void publish(uint64_t step, double stepsPerSecond, double stepInterval);
+};
@@ -0,0 +1,54 @@
+#include "SolverProfile.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static int currentThreads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+bool SolverProfile::load(const char* path) {
+    std::ifstream in(path);
+    if (!in) return false;
+    SolverProfile p;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        std::string key = line.substr(0, eq);
+        std::istringstream value(line.substr(eq + 1));
+        if (key == "maxLeafSize") value >> p.maxLeafSize;
+        else if (key == "buildTaskCutoff") value >> p.buildTaskCutoff;
+        else if (key == "forceChunk") value >> p.forceChunk;
+        else if (key == "threads") value >> p.threads;
+        else if (key == "theta") value >> p.theta;
+        else if (key == "forceError") value >> p.forceError;
+        else if (key == "stepMs") value >> p.stepMs;
+        if (value.fail()) return false;
+    }
+    if (p.threads != currentThreads() || p.maxLeafSize < 1 || p.buildTaskCutoff < 1 || p.forceChunk < 1) return false;
+    *this = p;
+    return true;
+}
+
+bool SolverProfile::save(const char* path) const {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "# Cosmos Engine solver profile, written by --autotune\n"
+        << "maxLeafSize=" << maxLeafSize << "\n"
+        << "buildTaskCutoff=" << buildTaskCutoff << "\n"
+        << "forceChunk=" << forceChunk << "\n"
+        << "threads=" << threads << "\n"
+        << "theta=" << theta << "\n"
+        << "forceError=" << forceError << "\n"
+        << "stepMs=" << stepMs << "\n";
+    return (bool)out;
+}
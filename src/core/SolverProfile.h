@@ -0,0 +1,21 @@
+#pragma once
+
+// Machine-specific solver parameters. Written by --autotune and loaded by
+// SimulationEngine at startup; without a profile the defaults below are used.
+struct SolverProfile {
+    static constexpr const char* kDefaultPath = "cosmos_solver.ini";
+
+    int maxLeafSize = 8;
+    int buildTaskCutoff = 4096; // subtrees larger than this are built as OpenMP tasks
+    int forceChunk = 256;       // particles per dynamically scheduled chunk of the force loop
+    // Provenance, checked on load and shown by --autotune
+    int threads = 0;
+    float theta = 0.0f;
+    double forceError = 0.0; // mean relative error against direct summation
+    double stepMs = 0.0;     // build + force at the tuned size
+
+    // Returns false (leaving *this untouched) if the file is missing, malformed
+    // or was tuned for a different OpenMP thread count
+    bool load(const char* path);
+    bool save(const char* path) const;
+};
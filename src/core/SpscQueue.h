@@ -0,0 +1,30 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free single-producer/single-consumer ring (Capacity must be a power of two)
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+public:
+    bool push(const T& v) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == Capacity) return false; // full
+        items[h & (Capacity - 1)] = v;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& out) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false; // empty
+        out = items[t & (Capacity - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[Capacity];
+    alignas(64) std::atomic<size_t> head{0}; // written by producer
+    alignas(64) std::atomic<size_t> tail{0}; // written by consumer
+};
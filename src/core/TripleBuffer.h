@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer triple buffer.
+// The producer fills writeBuffer() and publish()es it; the consumer calls
+// fetch() to swap in the newest published buffer and reads readBuffer().
+// Neither side ever waits and the consumer always sees a complete buffer.
+template <typename T>
+class TripleBuffer {
+public:
+    // Producer side
+    T& writeBuffer() { return buffers[back]; }
+    void publish() {
+        uint8_t prev = middle.exchange((uint8_t)(back | kFresh), std::memory_order_acq_rel);
+        back = prev & kIndexMask;
+    }
+
+    // Consumer side: returns true if a newer buffer was swapped in
+    bool fetch() {
+        if (!(middle.load(std::memory_order_relaxed) & kFresh)) return false;
+        uint8_t prev = middle.exchange(front, std::memory_order_acq_rel);
+        front = prev & kIndexMask;
+        return true;
+    }
+    const T& readBuffer() const { return buffers[front]; }
+
+private:
+    static constexpr uint8_t kIndexMask = 0x3;
+    static constexpr uint8_t kFresh = 0x4;
+    T buffers[3];
+    uint8_t front = 0;                // owned by consumer
+    std::atomic<uint8_t> middle{1};   // shared slot index | fresh flag
+    uint8_t back = 2;                 // owned by producer
+};
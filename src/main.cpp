@@ -7,8 +7,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
-#include "core/SimulationEngine.h"
+#include "core/SimulationThread.h"
+#include "core/AllocationTracker.h"
+#include "core/Benchmark.h"
+#include "core/QualityGovernor.h"
+#include "core/SimdKernels.h"
 #include "rendering/RenderingEngine.h"
 #include "ui/UIManager.h"
 
@@ -16,13 +22,103 @@ static void glfwErrorCallback(int error, const char* desc) {
     fprintf(stderr, "GLFW error %d: %s\n", error, desc);
 }
 
-int main() {
+// --check-allocations: run a fixed number of frames in a hidden window and fail
+// if steady-state SimulationEngine::update or RenderingEngine::render allocates;
+// with --bench, the timed steps of the headless run instead
+static const int kAllocCheckWarmup = 30;  // frames and simulation steps
+static const int kAllocCheckFrames = 120;
+static const int kAllocCheckSteps = 20;
+
+int main(int argc, char** argv) {
+    bool checkAllocations = false;
+    bool bench = false;
+    bool autotune = false;
+    bool checkRegularization = false;
+    BenchmarkOptions benchOpts;
+    AutotuneOptions tuneOpts;
+    for (int a = 1; a < argc; ++a) {
+        const char* arg = argv[a];
+        auto value = [&]() -> const char* { return (a + 1 < argc) ? argv[++a] : ""; };
+        if (std::strcmp(arg, "--check-allocations") == 0) checkAllocations = true;
+        else if (std::strcmp(arg, "--bench") == 0) bench = true;
+        else if (std::strcmp(arg, "--autotune") == 0) autotune = true;
+        else if (std::strcmp(arg, "--check-regularization") == 0) checkRegularization = true;
+        else if (std::strcmp(arg, "--alloc-probe") == 0) benchOpts.allocationProbe = true;
+        else if (std::strcmp(arg, "--target-error") == 0) tuneOpts.targetError = std::atof(value());
+        else if (std::strcmp(arg, "--steps") == 0) benchOpts.steps = std::atoi(value());
+        else if (std::strcmp(arg, "--particles") == 0) benchOpts.settings.particleCount = std::atoi(value());
+        else if (std::strcmp(arg, "--box") == 0) benchOpts.settings.boxSize = (float)std::atof(value());
+        else if (std::strcmp(arg, "--pm-grid") == 0) benchOpts.settings.pmGrid = std::atoi(value());
+        else if (std::strcmp(arg, "--solver") == 0) {
+            const char* name = value();
+            if (std::strcmp(name, "tree") == 0) benchOpts.settings.gravitySolver = GravitySolver::Tree;
+            else if (std::strcmp(name, "treepm") == 0) benchOpts.settings.gravitySolver = GravitySolver::TreePM;
+            else if (std::strcmp(name, "pm") == 0) benchOpts.settings.gravitySolver = GravitySolver::PM;
+            else { fprintf(stderr, "unknown solver: %s\n", name); return 2; }
+        } else if (std::strcmp(arg, "--kernel") == 0) {
+            const char* name = value();
+            if (std::strcmp(name, "plummer") == 0) benchOpts.settings.softeningKernel = SofteningKernel::Plummer;
+            else if (std::strcmp(name, "spline") == 0) benchOpts.settings.softeningKernel = SofteningKernel::CubicSpline;
+            else if (std::strcmp(name, "compact") == 0) benchOpts.settings.softeningKernel = SofteningKernel::Compact;
+            else { fprintf(stderr, "unknown kernel: %s\n", name); return 2; }
+        } else if (std::strcmp(arg, "--opening") == 0) {
+            const char* name = value();
+            if (std::strcmp(name, "geometric") == 0) benchOpts.settings.openingCriterion = OpeningCriterion::Geometric;
+            else if (std::strcmp(name, "salmon-warren") == 0) benchOpts.settings.openingCriterion = OpeningCriterion::SalmonWarren;
+            else if (std::strcmp(name, "relative") == 0) benchOpts.settings.openingCriterion = OpeningCriterion::RelativeAcceleration;
+            else { fprintf(stderr, "unknown opening criterion: %s\n", name); return 2; }
+        } else if (std::strcmp(arg, "--theta") == 0) benchOpts.settings.theta = (float)std::atof(value());
+        else if (std::strcmp(arg, "--alpha") == 0) benchOpts.settings.accelTolerance = (float)std::atof(value());
+        else if (std::strcmp(arg, "--double") == 0) benchOpts.settings.precision = ScalarPrecision::Double;
+        else if (std::strcmp(arg, "--2d") == 0) benchOpts.settings.dimensions = 2;
+        else if (std::strcmp(arg, "--coulomb") == 0) benchOpts.settings.coulombK = (float)std::atof(value());
+        else if (std::strcmp(arg, "--rebuild-every") == 0) benchOpts.settings.rebuildEveryN = std::atoi(value());
+        else if (std::strcmp(arg, "--lists") == 0) benchOpts.settings.interactionListGroup = std::atoi(value());
+        else if (std::strcmp(arg, "--pipeline-build") == 0) benchOpts.settings.pipelineBuild = true;
+        else if (std::strcmp(arg, "--check-forces") == 0) benchOpts.checkSamples = std::atoi(value());
+        else if (std::strcmp(arg, "--tracers") == 0) benchOpts.settings.tracerFraction = (float)std::atof(value());
+        else if (std::strcmp(arg, "--perf") == 0) benchOpts.settings.hardwareCounters = true;
+        else if (std::strcmp(arg, "--tree-stats") == 0) benchOpts.settings.treeStats = true;
+        else if (std::strcmp(arg, "--perf-main-thread") == 0) {
+            benchOpts.settings.hardwareCounters = true;
+            benchOpts.settings.hardwareCountersPerThread = false;
+        } else if (std::strcmp(arg, "--isa") == 0) {
+            const char* name = value();
+            SimdIsa isa;
+            if (!parseSimdIsa(name, isa)) { fprintf(stderr, "unknown instruction set: %s\n", name); return 2; }
+            if (!setSimdIsa(isa)) { fprintf(stderr, "%s is not supported by this CPU\n", simdIsaName(isa)); return 2; }
+        } else if (std::strcmp(arg, "--module") == 0) {
+            const char* name = value();
+            if (!parseModuleName(name, benchOpts.settings.module)) { fprintf(stderr, "unknown module: %s\n", name); return 2; }
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", arg);
+            return 2;
+        }
+    }
+    printf("simd: %s kernels (best supported %s) on %s\n", simdKernels().name, simdIsaName(bestSimdIsa()),
+           cpuBrand()[0] ? cpuBrand() : "unknown CPU");
+    if (checkAllocations && !AllocationTracker::enabled()) {
+        fprintf(stderr, "--check-allocations requires a build with -DCOSMOS_TRACK_ALLOCATIONS=ON\n");
+        return 2;
+    }
+    if (checkRegularization) return runRegularizationCheck(benchOpts.settings.encounterStepsPerOrbit);
+    // Headless benchmark: no window or GL context needed
+    if (bench) {
+        benchOpts.checkAllocations = checkAllocations;
+        return runBenchmark(benchOpts);
+    }
+    if (autotune) {
+        tuneOpts.settings = benchOpts.settings;
+        return runAutotune(tuneOpts);
+    }
+
     glfwSetErrorCallback(glfwErrorCallback);
     if (!glfwInit()) return -1;
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (checkAllocations) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     GLFWwindow* window = glfwCreateWindow(1600, 900, "Cosmos Engine", nullptr, nullptr);
     if (!window) { glfwTerminate(); return -1; }
@@ -37,24 +133,47 @@ int main() {
 
     UIManager ui; ui.init(window, "#version 450");
 
-    SimulationEngine sim;
     SimulationSettings settings;
     settings.particleCount = 80000; // cap enforced to 200k on reset
-    sim.reset(settings);
+    SimulationThread sim;
+    sim.start(settings);
 
     RenderingEngine renderer;
     renderer.init(1600, 900);
+    GovernorSettings governorSettings;
+    QualityGovernor governor;
 
     Camera camera;
     auto lastTime = std::chrono::high_resolution_clock::now();
     double fps = 0.0;
 
     // Input state (orbit camera)
-    bool rotating = false; bool panning = false;
+    bool rotating = false; bool panning = false; bool lmbWasDown = false;
     double lastX = 0, lastY = 0; double scrollAccum = 0.0;
     float lastYaw = 0.0f;
+    int frameIndex = 0, measuredFrames = 0;
+    uint64_t measureFromStep = 0;
+    AllocationCounters allocTotals[(int)FramePhase::Count];
 
     while (!glfwWindowShouldClose(window)) {
+        // counters of the frame that just finished
+        AllocationTracker::beginFrame();
+        if (checkAllocations) {
+            // the simulation runs on its own thread: measure once both sides are warm
+            uint64_t step = sim.latest().step;
+            if (frameIndex > kAllocCheckWarmup && step > (uint64_t)kAllocCheckWarmup) {
+                if (measuredFrames++ == 0) measureFromStep = step;
+                else {
+                    for (int p = 0; p < (int)FramePhase::Count; ++p) {
+                        AllocationCounters c = AllocationTracker::lastFrame((FramePhase)p);
+                        allocTotals[p].count += c.count; allocTotals[p].bytes += c.bytes;
+                    }
+                }
+            }
+            if (measuredFrames > kAllocCheckFrames && step >= measureFromStep + kAllocCheckSteps) break;
+        }
+        ++frameIndex;
+
         glfwPollEvents();
 
         // Resize
@@ -71,7 +190,7 @@ int main() {
             camera.pitch = glm::clamp(camera.pitch + (float)dy * 0.005f, -1.5f, 1.5f);
             // rotate scene to keep visual lock (optional: only for BH)
             if (settings.module == SimulationModule::BlackHole) {
-                sim.rotateAll(camera.yaw - prevYaw);
+                sim.rotate(camera.yaw - prevYaw);
             }
         } else rotating = false;
 
@@ -100,6 +219,8 @@ int main() {
         double mx, my; glfwGetCursorPos(window, &mx, &my);
         int ww, hh; glfwGetWindowSize(window, &ww, &hh);
         bool lmb = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        bool click = lmb && !lmbWasDown;
+        lmbWasDown = lmb;
         settings.toolEngaged = lmb;
         if (lmb) {
             // Convert mouse to NDC
@@ -127,24 +248,43 @@ int main() {
                 if (t > 0.0f) hit = rayO + rayD * t; else hit = camera.target;
             }
             settings.toolWorld = hit;
+            // With no tool selected a click picks the particle under the cursor (8 px tolerance at the target)
+            if (click && settings.tool == InteractionTool::None && !ImGui::GetIO().WantCaptureMouse) {
+                float pickRadius = 2.0f * camera.distance * tanf(glm::radians(camera.fov) * 0.5f) * 8.0f / (float)hh;
+                sim.pick(rayO, rayD, pickRadius);
+            }
         }
 
-        // Update simulation
-        sim.update(settings);
-
-        // UI frame
-        ui.beginFrame();
         auto now = std::chrono::high_resolution_clock::now();
         double dt = std::chrono::duration<double>(now - lastTime).count();
         lastTime = now;
         fps = 1.0 / (dt + 1e-6);
-    bool reset = ui.drawDock(settings, camera, (float)fps, sim.getParticles().size(), &renderer);
+
+        // Pick up the newest step; the governor derives effective quality from the user's settings
+        const ParticleSnapshot& snapshot = sim.latest();
+        governor.update(governorSettings, settings, renderer.getBlurPasses(), dt * 1000.0, snapshot);
+        SimulationSettings effective = settings;
+        governor.apply(effective);
+        sim.submitSettings(effective);
+        renderer.setBlurPassLimit(governor.blurPassLimit());
+        renderer.setRenderScale(governor.renderScale());
+
+        // UI frame
+        ui.beginFrame();
+    bool reset = ui.drawDock(settings, camera, (float)fps, snapshot.liveParticles, &renderer);
+    ui.drawPerformance(snapshot, &renderer);
+    ui.drawGovernor(governorSettings, governor, &renderer);
+    if (ui.drawInspector(snapshot, settings, camera, &renderer)) sim.clearPick();
     if (settings.particleCount > 200000) settings.particleCount = 200000;
-        if (reset) sim.reset(settings);
+        if (reset) sim.requestReset(settings);
+        sim.flush();
 
     // Render (enable lensing when module is BlackHole)
     bool isBH = (settings.module == SimulationModule::BlackHole);
-    renderer.render(sim, camera, false, isBH);
+    {
+        AllocationTracker::PhaseScope phase(FramePhase::Render);
+        renderer.render(snapshot, camera, false, isBH);
+    }
 
         // Draw indicator for tool
         if (settings.toolEngaged && settings.tool != InteractionTool::None) {
@@ -158,8 +298,10 @@ int main() {
         glfwSwapBuffers(window);
     }
 
+    sim.stop();
     ui.shutdown();
     glfwDestroyWindow(window);
     glfwTerminate();
+    if (checkAllocations) return reportAllocationCheck(allocTotals, false) ? 0 : 1;
     return 0;
 }
@@ -2,7 +2,10 @@
 #include <glad/glad.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+#include <chrono>
 
 static const float QUAD_VERTS[] = {
     // positions   // texcoords
@@ -69,6 +72,33 @@ void RenderingEngine::resize(int width, int height) {
     ensureFramebuffer();
 }
 
+glm::mat4 RenderingEngine::cameraProjection(const Camera& cam) const {
+    float aspect = (float)viewportW / (float)viewportH;
+    return glm::perspective(glm::radians(cam.fov), aspect, 0.1f, 5000.0f);
+}
+
+glm::mat4 RenderingEngine::cameraView(const Camera& cam) const {
+    glm::vec3 fwd = glm::normalize(glm::vec3(cosf(cam.pitch) * sinf(cam.yaw), sinf(cam.pitch), cosf(cam.pitch) * cosf(cam.yaw)));
+    glm::vec3 right = glm::normalize(glm::cross(fwd, glm::vec3(0,1,0)));
+    glm::vec3 up = glm::normalize(glm::cross(right, fwd));
+    return glm::lookAt(cam.position, cam.position + fwd, up);
+}
+
+bool RenderingEngine::projectToScreen(const Camera& cam, const glm::vec3& world, glm::vec2& out) const {
+    glm::vec4 clip = cameraProjection(cam) * cameraView(cam) * glm::vec4(world, 1.0f);
+    if (clip.w <= 0.0f) return false;
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    out = glm::vec2(ndc.x * 0.5f + 0.5f, 0.5f - ndc.y * 0.5f);
+    return fabsf(ndc.x) <= 1.0f && fabsf(ndc.y) <= 1.0f;
+}
+
+void RenderingEngine::setRenderScale(float s) {
+    s = glm::clamp(s, 0.25f, 1.0f);
+    if (s == renderScale) return;
+    renderScale = s;
+    if (hdrFBO) ensureFramebuffer();
+}
+
 void RenderingEngine::setupParticleBuffers(size_t maxParticles) {
     if (!particleVAO) glGenVertexArrays(1, &particleVAO);
     if (!particleVBO) glGenBuffers(1, &particleVBO);
@@ -80,7 +110,7 @@ void RenderingEngine::setupParticleBuffers(size_t maxParticles) {
     mappedCapacity = maxParticles * sizeof(GPUVertex);
     glBufferData(GL_ARRAY_BUFFER, mappedCapacity, nullptr, GL_DYNAMIC_DRAW);
 
-    // layout: position (vec3), radius (float), color(vec4), velocity(vec3), pad(float)
+    // layout: position (vec3), radius (float), color(vec4), velocity(vec3), id (uint32), prevPosition(vec3), pad(float)
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GPUVertex), (void*)offsetof(GPUVertex, position));
     glEnableVertexAttribArray(1);
@@ -89,19 +119,24 @@ void RenderingEngine::setupParticleBuffers(size_t maxParticles) {
     glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(GPUVertex), (void*)offsetof(GPUVertex, color));
     glEnableVertexAttribArray(3);
     glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(GPUVertex), (void*)offsetof(GPUVertex, velocity));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(GPUVertex), (void*)offsetof(GPUVertex, prevPosition));
     glBindVertexArray(0);
 }
 
 void RenderingEngine::ensureFramebuffer() {
     // Guard against zero-sized framebuffer (can happen before first valid resize)
     if (viewportW <= 0 || viewportH <= 0) { viewportW = 1; viewportH = 1; }
+    // Scene and bloom targets follow the render scale; the UI backdrop stays at viewport size
+    sceneW = std::max(1, (int)(viewportW * renderScale));
+    sceneH = std::max(1, (int)(viewportH * renderScale));
     if (!hdrFBO) glGenFramebuffers(1, &hdrFBO);
     glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
 
     auto createTex = [&](unsigned int& tex){
         if (!tex) glGenTextures(1, &tex);
         glBindTexture(GL_TEXTURE_2D, tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, viewportW, viewportH, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, sceneW, sceneH, 0, GL_RGBA, GL_FLOAT, nullptr);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -116,15 +151,15 @@ void RenderingEngine::ensureFramebuffer() {
 
     if (!depthRBO) glGenRenderbuffers(1, &depthRBO);
     glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, viewportW, viewportH);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, sceneW, sceneH);
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
 
     unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
     glDrawBuffers(2, attachments);
 
     // pingpong buffers for blur (half resolution)
-    pingW = std::max(1, viewportW / 2);
-    pingH = std::max(1, viewportH / 2);
+    pingW = std::max(1, sceneW / 2);
+    pingH = std::max(1, sceneH / 2);
     for (int i = 0; i < 2; ++i) {
         if (!pingpongFBO[i]) glGenFramebuffers(1, &pingpongFBO[i]);
         if (!pingpongTex[i]) glGenTextures(1, &pingpongTex[i]);
@@ -169,8 +204,8 @@ void RenderingEngine::drawFullscreenQuad() {
     glBindVertexArray(0);
 }
 
-void RenderingEngine::render(const SimulationEngine& sim, const Camera& cam, bool showVectors, bool isBlackHoleModule) {
-    const auto& pts = sim.getParticles();
+void RenderingEngine::render(const ParticleSnapshot& snapshot, const Camera& cam, bool showVectors, bool isBlackHoleModule) {
+    const auto& pts = snapshot.particles;
     if (pts.empty()) return;
 
     // Resize if needed and upload compact GPU data
@@ -180,25 +215,18 @@ void RenderingEngine::render(const SimulationEngine& sim, const Camera& cam, boo
         setupParticleBuffers(pts.size());
         glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
     }
-    gpuVertices.resize(pts.size());
-    for (size_t i = 0; i < pts.size(); ++i) {
-        gpuVertices[i].position = pts[i].position;
-        gpuVertices[i].radius = pts[i].radius;
-        gpuVertices[i].color = pts[i].color;
-        gpuVertices[i].velocity = pts[i].velocity;
-    }
-    glBufferSubData(GL_ARRAY_BUFFER, 0, needed, gpuVertices.data());
+    // Snapshots already use the vertex layout: one copy into the orphaned buffer
+    void* dst = glMapBufferRange(GL_ARRAY_BUFFER, 0, needed, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!dst) return;
+    std::memcpy(dst, pts.data(), needed);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
 
-    // Camera matrices
-    float aspect = (float)viewportW / (float)viewportH;
-    glm::mat4 proj = glm::perspective(glm::radians(cam.fov), aspect, 0.1f, 5000.0f);
-    glm::vec3 fwd = glm::normalize(glm::vec3(cosf(cam.pitch) * sinf(cam.yaw), sinf(cam.pitch), cosf(cam.pitch) * cosf(cam.yaw)));
-    glm::vec3 right = glm::normalize(glm::cross(fwd, glm::vec3(0,1,0)));
-    glm::vec3 up = glm::normalize(glm::cross(right, fwd));
-    glm::mat4 view = glm::lookAt(cam.position, cam.position + fwd, up);
+    // Camera matrices; the simulation frame's rotation folds into the view matrix: O(1) per frame
+    glm::mat4 proj = cameraProjection(cam);
+    glm::mat4 view = cameraView(cam) * glm::mat4_cast(snapshot.worldFrame);
 
     glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-    glViewport(0, 0, viewportW, viewportH);
+    glViewport(0, 0, sceneW, sceneH);
     glClearColor(0.0f, 0.0f, 0.02f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glDisable(GL_DEPTH_TEST);
@@ -208,6 +236,14 @@ void RenderingEngine::render(const SimulationEngine& sim, const Camera& cam, boo
     particleProg.setMat4("uView", view);
     particleProg.setMat4("uProj", proj);
     particleProg.setFloat("bloomThreshold", bloomThreshold);
+    // Interpolate between the last two simulation states (fixed-rate stepping)
+    float alpha = 1.0f;
+    if (snapshot.stepInterval > 0.0) {
+        double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        alpha = (float)glm::clamp((now - snapshot.publishTime) / snapshot.stepInterval, 0.0, 1.0);
+    }
+    particleProg.setFloat("uAlpha", alpha);
+    particleProg.setFloat("uPointScale", renderScale);
     unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
     glDrawBuffers(2, attachments);
 
@@ -224,7 +260,7 @@ void RenderingEngine::render(const SimulationEngine& sim, const Camera& cam, boo
     bool horizontal = true, first = true;
     blurProg.use();
     blurProg.setInt("inputTex", 0);
-    int passes = glm::clamp(blurPasses, 0, 10);
+    int passes = glm::clamp(std::min(blurPasses, blurPassLimit), 0, 10);
     for (int i = 0; i < passes; ++i) {
         glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
         blurProg.setInt("horizontal", horizontal ? 1 : 0);
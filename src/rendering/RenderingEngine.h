@@ -1,7 +1,7 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <vector>
-#include "../core/SimulationEngine.h"
+#include "../core/ParticleSnapshot.h"
 #include "ShaderProgram.h"
 
 struct Camera {
@@ -17,7 +17,7 @@ class RenderingEngine {
 public:
     bool init(int width, int height);
     void resize(int width, int height);
-    void render(const SimulationEngine& sim, const Camera& camera, bool showVectors, bool isBlackHoleModule);
+    void render(const ParticleSnapshot& snapshot, const Camera& camera, bool showVectors, bool isBlackHoleModule);
     ~RenderingEngine();
 
     // Post-process controls
@@ -27,15 +27,15 @@ public:
     float getBloomThreshold() const { return bloomThreshold; }
     void setBlurPasses(int p) { blurPasses = p; }
     int getBlurPasses() const { return blurPasses; }
+    // Quality governor: caps on top of the user settings
+    void setBlurPassLimit(int p) { blurPassLimit = p; }
+    void setRenderScale(float s); // scene resolution relative to the viewport, recreates targets
+    float getRenderScale() const { return renderScale; }
+    // World position -> window coordinates in [0,1] (origin top-left); false if off screen
+    bool projectToScreen(const Camera& camera, const glm::vec3& world, glm::vec2& out) const;
 
 private:
-    struct GPUVertex {
-        glm::vec3 position;
-        float radius;
-        glm::vec4 color;
-    glm::vec3 velocity;
-    float pad0;
-    };
+    using GPUVertex = RenderParticle;
     unsigned int particleVAO = 0, particleVBO = 0;
     void* mappedPtr = nullptr;
     size_t mappedCapacity = 0;
@@ -53,11 +53,13 @@ private:
     ShaderProgram compositeProg;
 
     int viewportW = 1, viewportH = 1;
+    int sceneW = 1, sceneH = 1;
+    float renderScale = 1.0f;
+    int blurPassLimit = 10;
     float exposure = 1.2f;
     float bloomThreshold = 0.6f;
     int blurPasses = 3;
     int uiBlurPasses = 6;
-    std::vector<GPUVertex> gpuVertices;
 
     // Black hole lensing and ring parameters
     bool lensingEnabled = false;
@@ -83,6 +85,8 @@ private:
     float haloIntensity = 0.8f;
     float tailAngle = 0.6f; // radians, direction of matter tail
 
+    glm::mat4 cameraProjection(const Camera& cam) const;
+    glm::mat4 cameraView(const Camera& cam) const;
     void setupParticleBuffers(size_t maxParticles);
     void ensureFramebuffer();
     void drawFullscreenQuad();
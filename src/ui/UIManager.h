@@ -4,6 +4,7 @@
 #include <GLFW/glfw3.h>
 #include <imgui.h>
 #include "../core/SimulationEngine.h"
+#include "../core/QualityGovernor.h"
 #include "../rendering/RenderingEngine.h"
 
 class UIManager {
@@ -14,6 +15,12 @@ public:
     void endFrame();
 
     bool drawDock(SimulationSettings& settings, Camera& camera, float fps, size_t particleCount, RenderingEngine* renderer = nullptr);
+    // Read-only diagnostics panel (memory placement, timings, counters)
+    void drawPerformance(const ParticleSnapshot& snapshot, RenderingEngine* renderer = nullptr);
+    // Picked particle details plus an on-screen marker; returns true when the pick is released
+    bool drawInspector(const ParticleSnapshot& snapshot, SimulationSettings& settings, const Camera& camera, RenderingEngine* renderer);
+    // Quality governor controls, current levels and decision log
+    void drawGovernor(GovernorSettings& settings, const QualityGovernor& governor, RenderingEngine* renderer = nullptr);
     // Glassmorphic panel: draw a rounded translucent card with blurred scene
     void drawGlassPanelBegin(const char* title, RenderingEngine* renderer, const ImVec2& pos, const ImVec2& size, float alpha = 0.6f);
     void drawGlassPanelEnd();